@@ -23,6 +23,8 @@
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
 int nlog = LOGSIZE;
+int extents;  // -e: map file blocks with extents
+int hashroot; // -h: root directory in the hashed format
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -40,6 +42,10 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+uint ebmap(struct dinode *din, uint fbn);
+uint ibmap(struct dinode *din, uint fbn);
+uint fbmap(struct dinode *din, uint fbn);
+void dirappend(uint dir, struct dirent *de);
 
 // convert to intel byte order
 ushort
@@ -76,8 +82,40 @@ main(int argc, char *argv[])
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
+  // -l nlog sets the number of log blocks;
+  // -e makes every inode extent-mapped;
+  // -h makes the root directory hashed.
+  for(;;){
+    if(argc >= 3 && strcmp(argv[1], "-l") == 0){
+      nlog = atoi(argv[2]);
+      argc -= 2;
+      argv += 2;
+    } else if(argc >= 2 && strcmp(argv[1], "-e") == 0){
+      extents = 1;
+      argc -= 1;
+      argv += 1;
+    } else if(argc >= 2 && strcmp(argv[1], "-h") == 0){
+      hashroot = 1;
+      argc -= 1;
+      argv += 1;
+    } else {
+      break;
+    }
+  }
+
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-l nlog] [-e] [-h] fs.img files...\n");
+    exit(1);
+  }
+
+  // the kernel wants room for two transactions, each with a
+  // descriptor, after the log super block.  A transaction must
+  // hold MAXOPBLOCKS blocks plus a truncate that frees blocks
+  // in every bitmap block (see sys_unlink()).
+  int mintxn = MAXOPBLOCKS + 1 + nbitmap;
+  if(nlog < 2*(mintxn+1) + 1 || nlog - 1 > MAXLOGSIZE){
+    fprintf(stderr, "mkfs: nlog must be between %d and %d\n",
+            2*(mintxn+1) + 1, MAXLOGSIZE + 1);
     exit(1);
   }
 
@@ -102,6 +140,7 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.features = xint(extents ? FS_EXTENTS : 0);
 
   printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
          nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
@@ -117,16 +156,22 @@ main(int argc, char *argv[])
 
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
+  if(hashroot){
+    rinode(rootino, &din);
+    din.flags = DI_HASHDIR;  // holes, so never extent-mapped
+    din.size = xint(NDIRHASH * BSIZE);
+    winode(rootino, &din);
+  }
 
   bzero(&de, sizeof(de));
   de.inum = xshort(rootino);
   strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
+  dirappend(rootino, &de);
 
   bzero(&de, sizeof(de));
   de.inum = xshort(rootino);
   strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  dirappend(rootino, &de);
 
   for(i = 2; i < argc; i++){
     // get rid of "user/"
@@ -155,7 +200,7 @@ main(int argc, char *argv[])
     bzero(&de, sizeof(de));
     de.inum = xshort(inum);
     strncpy(de.name, shortname, DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    dirappend(rootino, &de);
 
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -165,10 +210,12 @@ main(int argc, char *argv[])
 
   // fix size of root inode dir
   rinode(rootino, &din);
-  off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
-  winode(rootino, &din);
+  if(!(din.flags & DI_HASHDIR)){
+    off = xint(din.size);
+    off = ((off/BSIZE) + 1) * BSIZE;
+    din.size = xint(off);
+    winode(rootino, &din);
+  }
 
   balloc(freeblock);
 
@@ -235,7 +282,8 @@ ialloc(ushort type)
   struct dinode din;
 
   bzero(&din, sizeof(din));
-  din.type = xshort(type);
+  din.type = type;
+  din.flags = extents ? DI_EXTENTS : 0;
   din.nlink = xshort(1);
   din.size = xint(0);
   winode(inum, &din);
@@ -267,7 +315,6 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
@@ -275,22 +322,10 @@ iappend(uint inum, void *xp, int n)
   // printf("append inum %d at off %d sz %d\n", inum, off, n);
   while(n > 0){
     fbn = off / BSIZE;
-    assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
+    if(din.flags & DI_EXTENTS){
+      x = ebmap(&din, fbn);
     } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
+      x = fbmap(&din, fbn);
     }
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
@@ -303,3 +338,162 @@ iappend(uint inum, void *xp, int n)
   din.size = xint(off);
   winode(inum, &din);
 }
+
+// Return the disk block holding block fbn of an extent-mapped
+// file, allocating it if fbn is just past the end of the file.
+// Files only grow at the end, so fbn is always in the last
+// extent or just after it.
+uint
+ebmap(struct dinode *din, uint fbn)
+{
+  struct exthdr *h = (struct exthdr*)din->addrs;
+  struct extent *e = (struct extent*)(h + 1);
+  struct exthdr *lh = h;
+  struct extent *le = e, *last;
+  uint leaf = 0, max = NIEXTENT, x;
+  char buf[BSIZE];
+
+  if(xshort(h->depth) == 1){
+    leaf = xint(e[xshort(h->n)-1].pblk);
+    rsect(leaf, buf);
+    lh = (struct exthdr*)buf;
+    le = (struct extent*)(lh + 1);
+    max = NLEXTENT;
+  }
+  last = xshort(lh->n) > 0 ? &le[xshort(lh->n)-1] : 0;
+  if(last && fbn >= xint(last->lblk) &&
+     fbn < xint(last->lblk) + xint(last->len))
+    return xint(last->pblk) + fbn - xint(last->lblk);
+
+  assert(last == 0 || fbn == xint(last->lblk) + xint(last->len));
+  if(last && xint(last->pblk) + xint(last->len) == freeblock){
+    last->len = xint(xint(last->len) + 1);
+  } else {
+    if(xshort(lh->n) == max){
+      // start a new leaf block.
+      assert(xshort(h->depth) == 0 || xshort(h->n) < NIEXTENT);
+      if(leaf)
+        wsect(leaf, buf);
+      leaf = freeblock++;
+      bzero(buf, BSIZE);
+      lh = (struct exthdr*)buf;
+      le = (struct extent*)(lh + 1);
+      if(xshort(h->depth) == 0){
+        memmove(le, e, xshort(h->n) * sizeof(*e));
+        lh->n = h->n;
+        h->depth = xshort(1);
+        h->n = xshort(0);
+      }
+      e[xshort(h->n)].lblk = xshort(lh->n) > 0 ? le[0].lblk : xint(fbn);
+      e[xshort(h->n)].pblk = xint(leaf);
+      e[xshort(h->n)].len = xint(0);
+      h->n = xshort(xshort(h->n) + 1);
+    }
+    last = &le[xshort(lh->n)];
+    last->lblk = xint(fbn);
+    last->pblk = xint(freeblock);
+    last->len = xint(1);
+    lh->n = xshort(xshort(lh->n) + 1);
+  }
+  x = freeblock++;
+  if(leaf)
+    wsect(leaf, buf);
+  return x;
+}
+
+// Return the disk block holding block fbn (>= NDIRECT) of a
+// file mapped with indirect blocks, allocating it and any
+// missing indirect blocks on the way.
+uint
+ibmap(struct dinode *din, uint fbn)
+{
+  uint indirect[NINDIRECT];
+  uint r, span, level, addr, x;
+
+  r = fbn - NDIRECT;
+  for(level = 1, span = NINDIRECT; r >= span; level++, span *= NINDIRECT){
+    assert(level < 3);
+    r -= span;
+  }
+  if(xint(din->addrs[NDIRECT+level-1]) == 0)
+    din->addrs[NDIRECT+level-1] = xint(freeblock++);
+  addr = xint(din->addrs[NDIRECT+level-1]);
+  for(;;){
+    span /= NINDIRECT;
+    rsect(addr, (char*)indirect);
+    if(indirect[r / span] == 0){
+      indirect[r / span] = xint(freeblock++);
+      wsect(addr, (char*)indirect);
+    }
+    x = xint(indirect[r / span]);
+    if(span == 1)
+      return x;
+    addr = x;
+    r %= span;
+  }
+}
+
+// Return the disk block holding block fbn of a file that is not
+// extent-mapped, allocating it if need be.
+uint
+fbmap(struct dinode *din, uint fbn)
+{
+  if(fbn >= NDIRECT)
+    return ibmap(din, fbn);
+  if(xint(din->addrs[fbn]) == 0){
+    din->addrs[fbn] = xint(freeblock++);
+  }
+  return xint(din->addrs[fbn]);
+}
+
+// Add de to directory dir, in the hashed format if the
+// directory is hashed (see fs.h), or else at the end.
+void
+dirappend(uint dir, struct dirent *de)
+{
+  struct dinode din;
+  struct dirent buf[DPB], buf0[DPB];
+  struct dirhdr *h;
+  uint b, i, k, x;
+
+  rinode(dir, &din);
+  if(!(din.flags & DI_HASHDIR)){
+    iappend(dir, de, sizeof(*de));
+    return;
+  }
+
+  if(strcmp(de->name, ".") == 0 || strcmp(de->name, "..") == 0){
+    b = 0;
+    i = de->name[1] ? 2 : 1;
+    x = fbmap(&din, 0);
+    rsect(x, buf);
+  } else {
+    b = dirhash(de->name) % NDIRHASH;
+    for(k = 0; k < DIRPROBE; k++, b = (b + 1) % NDIRHASH){
+      x = fbmap(&din, b);
+      rsect(x, buf);
+      for(i = (b == 0 ? 3 : 1); i < DPB && buf[i].inum != 0; i++)
+        ;
+      if(i < DPB)
+        break;
+      h = (struct dirhdr*)buf;
+      h->overflow = xshort(1);
+      wsect(x, buf);
+    }
+    assert(k < DIRPROBE);
+  }
+  buf[i] = *de;
+  h = (struct dirhdr*)buf;
+  h->count = xshort(xshort(h->count) + 1);
+  if(b == 0){
+    h->total = xint(xint(h->total) + 1);
+    wsect(x, buf);
+  } else {
+    wsect(x, buf);
+    rsect(fbmap(&din, 0), buf0);
+    h = (struct dirhdr*)buf0;
+    h->total = xint(xint(h->total) + 1);
+    wsect(fbmap(&din, 0), buf0);
+  }
+  winode(dir, &din);
+}
@@ -26,7 +26,9 @@ main()
     plicinit();          // 设置中断控制器
     plicinithart();      // 向PLIC请求设备中断
     binit();             // 缓冲区缓存初始化
+    textinit();          // 共享程序页面缓存初始化
     iinit();             // inode表初始化
+    dcacheinit();        // 目录项缓存初始化
     fileinit();          // 文件表初始化
     virtio_disk_init();  // 虚拟硬盘初始化
     userinit();          // 创建第一个用户进程
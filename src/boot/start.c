@@ -12,10 +12,10 @@ void timerinit();
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
 // 每个CPU的机器模式定时器中断的临时存储区域
-// 每个CPU需要5个64位字的空间来保存中断处理时的上下文
-uint64 timer_scratch[NCPU][5];
+// 每个CPU需要7个64位字，布局见 timerinit()
+uint64 timer_scratch[NCPU][7];
 
-// kernelvec.S中的汇编代码，用于处理机器模式的定时器中断
+// kernelvec.S中的汇编代码，用于处理机器模式的定时器中断和软件中断
 extern void timervec();
 
 // entry.S在机器模式下跳转到此处，使用stack0栈空间
@@ -75,9 +75,13 @@ timerinit()
   // scratch[0..2] : timervec保存寄存器的空间
   // scratch[3] : CLINT MTIMECMP寄存器地址
   // scratch[4] : 定时器中断之间期望的间隔(周期数)
+  // scratch[5] : CLINT MSIP寄存器地址
+  // scratch[6] : 时钟标志，区分定时器中断和核间中断
   uint64 *scratch = &timer_scratch[id][0];
   scratch[3] = CLINT_MTIMECMP(id);
   scratch[4] = interval;
+  scratch[5] = CLINT_MSIP(id);
+  scratch[6] = 0;
   w_mscratch((uint64)scratch);
 
   // 设置机器模式的陷阱处理程序
@@ -86,6 +90,6 @@ timerinit()
   // 启用机器模式中断
   w_mstatus(r_mstatus() | MSTATUS_MIE);
 
-  // 启用机器模式定时器中断
-  w_mie(r_mie() | MIE_MTIE);
+  // 启用机器模式定时器中断和软件中断（核间中断）
+  w_mie(r_mie() | MIE_MTIE | MIE_MSIE);
 }
@@ -12,10 +12,21 @@ struct superblock;
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+void            breadahead(uint, uint*, int);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+struct buf*     bnew(uint, uint);
+void            bwritev(struct buf**, int);
+void            bdwrite(struct buf*);
+int             bflush(uint, uint);
+void            bflusher(void);
+int             bdirtycount(void);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             bshrink(void);
+int             bcachesize(void);
+extern uint64   bcachehits, bcachemisses, bcacheevicts, breadaheads;
+extern uint64   bwritebacks;
 
 // console.c
 void            consoleinit(void);
@@ -24,6 +35,8 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+int             execfault(struct proc*, uint64, int);
+extern uint64   execfaults;
 
 // file.c
 struct file*    filealloc(void);
@@ -34,13 +47,24 @@ int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
 
+// dcache.c
+void            dcacheinit(void);
+int             dcache_lookup(uint, uint, char*, uint*, uint*);
+void            dcache_enter(uint, uint, char*, uint, uint);
+void            dcache_purge(uint, uint);
+extern uint64   dcachehits, dcachemisses;
+
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
+void            dirunlink(struct inode*, char*, uint);
+int             hdircount(struct inode*);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit();
+int             ishrink(void);
+int             icachesize(void);
 void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
@@ -51,8 +75,10 @@ struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
+extern uint64   icachehits, ireads;
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
+int             itruncblocks(struct inode*);
 
 // ramdisk.c
 void            ramdiskinit(void);
@@ -63,12 +89,24 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            kaddref(void *);
+int             krefcnt(void *);
+
+// textcache.c
+void            textinit(void);
+char*           textget(uint, uint, uint, uint);
+char*           textput(uint, uint, uint, uint, char*);
+void            textinval(uint, uint);
+int             textreclaim(void);
+extern uint64   texthits;
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
+void            begin_opn(int);
 void            end_op(void);
+void            log_force(void);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
@@ -100,6 +138,7 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+void            wakeone(void*);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
@@ -108,6 +147,12 @@ void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            yield(void);
+void            setrunnable(struct proc*);
+void            schedtick(void);
+int             setpriority(int, int);
+int             setaffinity(int, int);
+int             getaffinity(int);
+int             kthread_create(void (*)(void), char*);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -123,6 +168,7 @@ void            pop_off(void);
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
+int             tryacquiresleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
@@ -149,6 +195,9 @@ void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+void            timerstop(void);
+void            timerstart(void);
+void            ipi(int);
 
 // uart.c
 void            uartinit(void);
@@ -167,6 +216,10 @@ void            uvmfirst(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcow(pagetable_t, uint64);
+int             vmfault(pagetable_t, uint64, int);
+uint64          uvmfaultin(pagetable_t, uint64, uint64, int);
+uint64          uvmfaultpage(pagetable_t, uint64, uint64, int);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
@@ -185,6 +238,9 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_submit(struct buf *, int);
+void            virtio_disk_submitv(struct buf **, int, int);
+void            virtio_disk_wait(struct buf *);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
@@ -80,12 +80,25 @@ int
 consoleread(int user_dst, uint64 dst, int n)
 {
   uint target;
-  int c;
+  int c, ready;
   char cbuf;
 
+  // either_copyout() under cons.lock must not fault in a program
+  // page, which may sleep (see execfault()); fault the user
+  // buffer in a page at a time with the lock released.
+  ready = n;
+  if(user_dst)
+    ready = uvmfaultpage(myproc()->pagetable, dst, n, 1);
   target = n;
   acquire(&cons.lock);
   while(n > 0){
+    if(ready == 0){
+      release(&cons.lock);
+      ready = uvmfaultpage(myproc()->pagetable, dst, n, 1);
+      acquire(&cons.lock);
+      if(ready == 0)
+        break;
+    }
     // wait until interrupt handler has put some
     // input into cons.buffer.
     while(cons.r == cons.w){
@@ -114,6 +127,7 @@ consoleread(int user_dst, uint64 dst, int n)
 
     dst++;
     --n;
+    --ready;
 
     if(c == '\n'){
       // a whole line has arrived, return to
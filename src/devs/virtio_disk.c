@@ -4,6 +4,16 @@
 //
 // qemu ... -drive file=fs.img,if=none,format=raw,id=x0 -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0
 //
+// virtio_disk_submit() and virtio_disk_submitv() queue requests
+// and return at once, so that many can be in flight; a buf's
+// disk flag stays set until virtio_disk_intr() sees it complete,
+// and virtio_disk_wait() sleeps until then.  virtio_disk_rw()
+// does both.
+//
+// virtio_disk_submitv() turns each run of bufs with consecutive
+// block numbers into a single request with one data descriptor
+// per buf, so that the device sees one multi-sector transfer.
+//
 
 #include "types.h"
 #include "riscv.h"
@@ -19,6 +29,9 @@
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
 
+// most bufs in one request.
+#define MAXRUN 16
+
 static struct disk {
   // a set (not a ring) of DMA descriptors, with which the
   // driver tells the device where to read and write individual
@@ -40,6 +53,7 @@ static struct disk {
 
   // our own book-keeping.
   char free[NUM];  // is a descriptor free?
+  int free_count;  // number of free descriptors
   uint16 used_idx; // we've looked this far in used[2..NUM].
 
   // track info about in-flight operations,
@@ -144,6 +158,7 @@ virtio_disk_init(void)
   // all NUM descriptors start out unused.
   for(int i = 0; i < NUM; i++)
     disk.free[i] = 1;
+  disk.free_count = NUM;
 
   // tell device we're completely ready.
   status |= VIRTIO_CONFIG_S_DRIVER_OK;
@@ -159,6 +174,7 @@ alloc_desc()
   for(int i = 0; i < NUM; i++){
     if(disk.free[i]){
       disk.free[i] = 0;
+      disk.free_count--;
       return i;
     }
   }
@@ -178,6 +194,7 @@ free_desc(int i)
   disk.desc[i].flags = 0;
   disk.desc[i].next = 0;
   disk.free[i] = 1;
+  disk.free_count++;
   wakeup(&disk.free[0]);
 }
 
@@ -196,12 +213,13 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
 static int
-alloc3_desc(int *idx)
+alloc_descs(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  if(disk.free_count < n)
+    return -1;
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -212,21 +230,23 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// queue a request to read or write the n bufs in bs, which
+// hold consecutive blocks, without notifying the device.
+// caller holds disk.vdisk_lock.
+static void
+queue_rw(struct buf **bs, int n, int write)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
+  uint64 sector = bs[0]->blockno * (BSIZE / 512);
+  int i;
 
   // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
+  // a descriptor for type/reserved/sector, descriptors for the
+  // data, and one for a 1-byte status result.
 
-  // allocate the three descriptors.
-  int idx[3];
+  // allocate the descriptors.
+  int idx[MAXRUN+2];
   while(1){
-    if(alloc3_desc(idx) == 0) {
+    if(alloc_descs(idx, n+2) == 0) {
       break;
     }
     sleep(&disk.free[0], &disk.vdisk_lock);
@@ -249,24 +269,30 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  for(i = 0; i < n; i++){
+    struct buf *b = bs[i];
+    disk.desc[idx[1+i]].addr = (uint64) b->data;
+    disk.desc[idx[1+i]].len = BSIZE;
+    if(write)
+      disk.desc[idx[1+i]].flags = 0; // device reads b->data
+    else
+      disk.desc[idx[1+i]].flags = VRING_DESC_F_WRITE; // device writes b->data
+    disk.desc[idx[1+i]].flags |= VRING_DESC_F_NEXT;
+    disk.desc[idx[1+i]].next = idx[2+i];
+
+    // chain the bufs for virtio_disk_intr().
+    b->disk = 1;
+    b->qnext = i+1 < n ? bs[i+1] : 0;
+  }
 
   disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  disk.desc[idx[n+1]].addr = (uint64) &disk.info[idx[0]].status;
+  disk.desc[idx[n+1]].len = 1;
+  disk.desc[idx[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[idx[n+1]].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // record the first struct buf for virtio_disk_intr().
+  disk.info[idx[0]].b = bs[0];
 
   // tell the device the first index in our chain of descriptors.
   disk.avail->ring[disk.avail->idx % NUM] = idx[0];
@@ -275,22 +301,66 @@ virtio_disk_rw(struct buf *b, int write)
 
   // tell the device another avail ring entry is available.
   disk.avail->idx += 1; // not % NUM ...
+}
 
-  __sync_synchronize();
+// start reading or writing each of the n bufs in bs, and
+// return without waiting for the disk; call virtio_disk_wait()
+// before using a buf's data or reusing it.  the device is
+// notified once for the whole batch.  the caller must keep
+// the bufs from being recycled until they complete.
+void
+virtio_disk_submitv(struct buf **bs, int n, int write)
+{
+  if(n <= 0)
+    return;
+
+  acquire(&disk.vdisk_lock);
+  for(int i = 0, m; i < n; i += m){
+    // bs[i..i+m-1] hold consecutive blocks.
+    for(m = 1; i+m < n && m < MAXRUN; m++){
+      if(bs[i+m]->dev != bs[i]->dev || bs[i+m]->blockno != bs[i]->blockno + m)
+        break;
+    }
+    for(int j = i; j < i+m; j++)
+      if(bs[j]->disk)
+        panic("virtio_disk_submitv: busy");
+    queue_rw(bs+i, m, write);
+    if(i+m == n || disk.free_count < MAXRUN+2){
+      // let the device start on what is queued before we
+      // might have to wait for descriptors.
+      __sync_synchronize();
+      *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+    }
+  }
+  release(&disk.vdisk_lock);
+}
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+// start reading or writing b; see virtio_disk_submitv().
+void
+virtio_disk_submit(struct buf *b, int write)
+{
+  virtio_disk_submitv(&b, 1, write);
+}
 
-  // Wait for virtio_disk_intr() to say request has finished.
+// wait for the request on b, if any, to finish.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
-
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
-
   release(&disk.vdisk_lock);
 }
 
+// read or write b and wait for the disk to finish.
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_submit(b, write);
+  virtio_disk_wait(b);
+}
+
 void
 virtio_disk_intr()
 {
@@ -307,7 +377,8 @@ virtio_disk_intr()
   __sync_synchronize();
 
   // the device increments disk.used->idx when it
-  // adds an entry to the used ring.
+  // adds an entry to the used ring.  complete every
+  // request the device has finished, not just one.
 
   while(disk.used_idx != disk.used->idx){
     __sync_synchronize();
@@ -316,9 +387,14 @@ virtio_disk_intr()
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    struct buf *b = disk.info[id].b, *nb;
+    disk.info[id].b = 0;
+    free_chain(id);
+    for(; b; b = nb){
+      nb = b->qnext;
+      b->disk = 0;   // disk is done with buf
+      wakeup(b);
+    }
 
     disk.used_idx += 1;
   }
@@ -1,9 +1,33 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
-// cached copies of disk block contents.  Caching disk blocks
-// in memory reduces the number of disk reads and also provides
-// a synchronization point for disk blocks used by multiple processes.
+// The buffer cache is a hash table of buf structures holding
+// cached copies of disk block contents, keyed by (dev, blockno)
+// with a lock per bucket, so that lookups of different blocks
+// rarely contend.  Caching disk blocks in memory reduces the
+// number of disk reads and also provides a synchronization
+// point for disk blocks used by multiple processes.
+//
+// The cache starts with NBUF buffers and grows on demand, a
+// page of buffers at a time, up to 1/BCACHEFRAC of physical
+// memory.  Once it cannot grow, a buffer that is needed for a
+// new block is the unreferenced one released longest ago.
+// When kalloc() runs out of memory it calls bshrink(), which
+// gives back pages whose buffers are all unreferenced.
+//
+// breadahead() starts reads of blocks that readi() expects to
+// need soon and returns without waiting; a buffer's disk flag
+// stays set until its read completes, and bread() waits for it.
+//
+// The cache is write-back: bdwrite() marks a buffer dirty instead
+// of writing it, and bflush() later writes dirty buffers in
+// ascending block order, so that runs of adjacent blocks go to
+// the disk as single requests.  Dirty buffers are not evicted
+// until they are written back; when every unreferenced buffer
+// is dirty, bref() writes the oldest one back itself.  The
+// bflusher() kernel thread writes back blocks that have been
+// dirty for BDIRTYTICKS ticks, or all of them once more than
+// 1/BDIRTYFRAC of the cache is dirty; bdwrite() wakes it as soon
+// as that happens.
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
@@ -16,6 +40,7 @@
 
 #include "types.h"
 #include "param.h"
+#include "memlayout.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "riscv.h"
@@ -23,69 +48,345 @@
 #include "fs.h"
 #include "buf.h"
 
+#define NBUCKET  251
+#define BSHRINK  16   // most pages bshrink() frees per call
+#define BFLUSHMAX 32  // most blocks bflush() writes at once
+
+// A page of buffers allocated as the cache grows.
+#define BPERPAGE ((PGSIZE - sizeof(struct bpage*)) / sizeof(struct buf))
+struct bpage {
+  struct buf buf[BPERPAGE];
+  struct bpage *next;
+};
+
 struct {
+  // Serializes eviction, growing and shrinking, so that at
+  // most one process at a time moves buffers between lists.
+  // Also protects empty, pages and npages.
   struct spinlock lock;
   struct buf buf[NBUF];
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  // Buffers that hold no block, chained through next.
+  // Their dev is 0.
+  struct buf *empty;
+
+  // Pages of buffers added by bgrow().
+  struct bpage *pages;
+  int npages;
+  int maxpages;
+
+  int ndirty;     // buffers with dirty set
+
+  // Hash table of buffers keyed by (dev, blockno), chained
+  // through next.  Each bucket's lock protects its chain and
+  // the refcnt, lastuse, dev and blockno of the buffers on it.
+  struct {
+    struct spinlock lock;
+    struct buf *head;
+  } bucket[NBUCKET];
 } bcache;
 
+// statistics for sizing the cache, read by kstat().
+uint64 bcachehits;
+uint64 bcachemisses;
+uint64 bcacheevicts;
+uint64 breadaheads;    // blocks read ahead
+uint64 bwritebacks;    // dirty blocks written back
+
+static uint
+bhash(uint dev, uint blockno)
+{
+  return (dev * 31 + blockno) % NBUCKET;
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  int i;
+
+  if(sizeof(struct bpage) > PGSIZE)
+    panic("binit: bpage");
 
   initlock(&bcache.lock, "bcache");
+  for(i = 0; i < NBUCKET; i++)
+    initlock(&bcache.bucket[i].lock, "bcache_bucket");
+  bcache.maxpages = (PHYSTOP - KERNBASE) / PGSIZE / BCACHEFRAC;
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->next = bcache.empty;
+    bcache.empty = b;
   }
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
-static struct buf*
-bget(uint dev, uint blockno)
+// Number of buffers in the cache.
+int
+bcachesize(void)
+{
+  return NBUF + bcache.npages * BPERPAGE;
+}
+
+// Add a page of empty buffers, if the cache may grow and
+// there is a free page.  Caller holds bcache.lock.
+static void
+bgrow(void)
 {
+  struct bpage *pg;
   struct buf *b;
 
+  if(bcache.npages >= bcache.maxpages)
+    return;
+  if((pg = (struct bpage*)kalloc()) == 0)
+    return;
+  memset(pg, 0, sizeof(*pg));
+  for(b = pg->buf; b < &pg->buf[BPERPAGE]; b++){
+    initsleeplock(&b->lock, "buffer");
+    b->next = bcache.empty;
+    bcache.empty = b;
+  }
+  pg->next = bcache.pages;
+  bcache.pages = pg;
+  bcache.npages++;
+}
+
+// Remove b from the list it is on.  Caller holds
+// bcache.lock and the lock of b's bucket.
+static void
+bunlink(struct buf *b)
+{
+  struct buf **pp;
+
+  if(b->dev == 0)
+    pp = &bcache.empty;
+  else
+    pp = &bcache.bucket[bhash(b->dev, b->blockno)].head;
+  for(; *pp != b; pp = &(*pp)->next)
+    ;
+  *pp = b->next;
+}
+
+// Give back pages of buffers that nobody is using.
+// Called by kalloc() when memory runs out.
+// Returns the number of pages freed.
+int
+bshrink(void)
+{
+  struct bpage *pg, **pp;
+  struct buf *b;
+  int i, n = 0;
+
+  // kalloc() from bgrow() must not come back here.
+  if(holding(&bcache.lock))
+    return 0;
+
   acquire(&bcache.lock);
+  for(i = 0; i < NBUCKET; i++)
+    acquire(&bcache.bucket[i].lock);
+
+  pp = &bcache.pages;
+  while((pg = *pp) != 0 && n < BSHRINK){
+    for(b = pg->buf; b < &pg->buf[BPERPAGE]; b++)
+      if(b->refcnt != 0 || b->disk || b->dirty)
+        break;
+    if(b < &pg->buf[BPERPAGE]){
+      pp = &pg->next;
+      continue;
+    }
+    for(b = pg->buf; b < &pg->buf[BPERPAGE]; b++)
+      bunlink(b);
+    *pp = pg->next;
+    bcache.npages--;
+    kfree(pg);
+    n++;
+  }
+
+  for(i = 0; i < NBUCKET; i++)
+    release(&bcache.bucket[i].lock);
+  release(&bcache.lock);
+  return n;
+}
 
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+// Find the buffer for (dev, blockno) in bucket h and take
+// a reference to it.  Caller holds the bucket's lock.
+static struct buf*
+bfind(int h, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bcache.bucket[h].head; b; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
       return b;
     }
   }
+  return 0;
+}
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+// Take the unreferenced clean buffer that was released longest
+// ago out of its bucket.  Caller holds bcache.lock.  If every
+// unreferenced buffer is dirty, returns 0 and sets *dev and
+// *blockno to the block of the one released longest ago, which
+// the caller must write back before trying again.
+static struct buf*
+bevict(uint *dev, uint *blockno)
+{
+  struct buf *b, *victim, **pp, **vpp;
+  uint dirtyuse = 0;
+  int i, vh;
+
+  // Keep the lock of the bucket holding the best candidate
+  // so far, so that nobody can take it meanwhile.  Holding
+  // two bucket locks cannot deadlock, since everybody else
+  // holds at most one.
+  victim = 0;
+  vpp = 0;
+  vh = -1;
+  *dev = 0;
+  for(i = 0; i < NBUCKET; i++){
+    int better = 0;
+    acquire(&bcache.bucket[i].lock);
+    for(pp = &bcache.bucket[i].head; (b = *pp) != 0; pp = &b->next){
+      // a buffer may be unreferenced while the disk is still
+      // reading into it, if its read was started without
+      // waiting.  a dirty buffer must be written back first.
+      if(b->refcnt == 0 && !b->disk && !b->dirty &&
+         (victim == 0 || b->lastuse < victim->lastuse)){
+        victim = b;
+        vpp = pp;
+        better = 1;
+      }
+      if(b->refcnt == 0 && !b->disk && b->dirty &&
+         (*dev == 0 || b->lastuse < dirtyuse)){
+        *dev = b->dev;
+        *blockno = b->blockno;
+        dirtyuse = b->lastuse;
+      }
+    }
+    if(better){
+      if(vh >= 0 && vh != i)
+        release(&bcache.bucket[vh].lock);
+      vh = i;
+    } else {
+      release(&bcache.bucket[i].lock);
     }
   }
-  panic("bget: no buffers");
+  if(victim == 0){
+    if(*dev == 0)
+      panic("bget: no buffers");
+    return 0;
+  }
+
+  *vpp = victim->next;
+  release(&bcache.bucket[vh].lock);
+  __sync_fetch_and_add(&bcacheevicts, 1);
+  return victim;
+}
+
+static void bunref(struct buf*);
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer, and set *fresh.
+// In either case, return the buffer with a reference
+// taken but not locked.  A fresh buffer has valid == 0 and
+// nobody else can have found it yet.
+static struct buf*
+bref(uint dev, uint blockno, int *fresh)
+{
+  struct buf *b;
+  uint ddev, dblockno = 0;
+  int h = bhash(dev, blockno), dfresh;
+
+  *fresh = 0;
+again:
+  acquire(&bcache.bucket[h].lock);
+  b = bfind(h, dev, blockno);
+  release(&bcache.bucket[h].lock);
+  if(b)
+    return b;
+
+  // Not cached.  Only one process evicts at a time, so
+  // nobody else can add the block while we look for a
+  // buffer; but someone may have added it before we got
+  // the eviction lock.
+  acquire(&bcache.lock);
+  acquire(&bcache.bucket[h].lock);
+  b = bfind(h, dev, blockno);
+  release(&bcache.bucket[h].lock);
+  if(b){
+    release(&bcache.lock);
+    return b;
+  }
+
+  // Prefer an empty buffer, then growing the cache, and
+  // only then throwing a cached block away.
+  if(bcache.empty == 0)
+    bgrow();
+  if((b = bcache.empty) != 0){
+    bcache.empty = b->next;
+  } else if((b = bevict(&ddev, &dblockno)) == 0){
+    // every unreferenced buffer is dirty: write the oldest
+    // back and look again.  never sleep on its lock, since
+    // our caller may hold buffers its holder waits for.
+    release(&bcache.lock);
+    b = bref(ddev, dblockno, &dfresh);
+    if(tryacquiresleep(&b->lock)){
+      if(b->dirty){
+        bwrite(b);
+        __sync_fetch_and_add(&bwritebacks, 1);
+      }
+      releasesleep(&b->lock);
+    }
+    bunref(b);
+    goto again;
+  }
+
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->refcnt = 1;
+  acquire(&bcache.bucket[h].lock);
+  b->next = bcache.bucket[h].head;
+  bcache.bucket[h].head = b;
+  release(&bcache.bucket[h].lock);
+  release(&bcache.lock);
+
+  *fresh = 1;
+  return b;
+}
+
+// Drop a reference taken by bref().
+// Record when the buffer was last used, for eviction.
+static void
+bunref(struct buf *b)
+{
+  int h = bhash(b->dev, b->blockno);
+
+  acquire(&bcache.bucket[h].lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    // no one is waiting for it.
+    b->lastuse = ticks;
+  }
+  release(&bcache.bucket[h].lock);
+}
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.
+// In either case, return locked buffer.
+static struct buf*
+bget(uint dev, uint blockno)
+{
+  struct buf *b;
+  int fresh;
+
+  b = bref(dev, blockno, &fresh);
+  if(fresh)
+    __sync_fetch_and_add(&bcachemisses, 1);
+  else
+    __sync_fetch_and_add(&bcachehits, 1);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 /// @brief 从指定设备和块号读取一个块，并返回指向该块的缓冲区指针。
@@ -96,23 +397,232 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if(!b->valid) {
-    virtio_disk_rw(b, 0);
+    virtio_disk_submit(b, 0);
     b->valid = 1;
   }
+  // the read may have been started by breadahead(), or by
+  // us just now; wait for the data to arrive.
+  if(b->disk)
+    virtio_disk_wait(b);
+  return b;
+}
+
+// Start reading the n blocks in blocknos into the cache, without
+// waiting, so that a later bread() of them finds the data
+// there or on its way.  Blocks that are already cached are
+// skipped, and all the reads go to the disk as one batch.
+void
+breadahead(uint dev, uint *blocknos, int n)
+{
+  struct buf *b, *bs[RAMAX];
+  int i, m, fresh;
+
+  if(n > RAMAX)
+    n = RAMAX;
+  m = 0;
+  for(i = 0; i < n; i++){
+    b = bref(dev, blocknos[i], &fresh);
+    if(!fresh){
+      bunref(b);
+      continue;
+    }
+    // nobody else has seen b, so its lock is free.
+    acquiresleep(&b->lock);
+    bs[m++] = b;
+  }
+
+  virtio_disk_submitv(bs, m, 0);
+  __sync_fetch_and_add(&breadaheads, m);
+
+  // valid now means the data is in memory or on its way;
+  // bread() waits for reads that are still in flight, and
+  // eviction skips their buffers.
+  for(i = 0; i < m; i++){
+    bs[i]->valid = 1;
+    brelse(bs[i]);
+  }
+}
+
+// Return a locked buffer for a block whose old contents the
+// caller is going to overwrite completely, without reading
+// it from the disk.
+struct buf*
+bnew(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  if(b->disk)
+    virtio_disk_wait(b);
+  b->valid = 1;
   return b;
 }
 
+// The disk now has b's contents.  Caller holds b's lock.
+static void
+bclean(struct buf *b)
+{
+  if(b->dirty){
+    b->dirty = 0;
+    __sync_fetch_and_sub(&bcache.ndirty, 1);
+  }
+}
+
+// Write the n locked buffers in bs to disk as one batch,
+// and wait until all of them are written.
+void
+bwritev(struct buf **bs, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bs[i]->lock))
+      panic("bwritev");
+    virtio_disk_wait(bs[i]);
+  }
+  virtio_disk_submitv(bs, n, 1);
+  for(i = 0; i < n; i++){
+    virtio_disk_wait(bs[i]);
+    bclean(bs[i]);
+  }
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
+  virtio_disk_wait(b);
   virtio_disk_rw(b, 1);
+  bclean(b);
+}
+
+// Mark b, whose contents the caller changed, to be written
+// to disk later by bflush().  Must be locked.
+void
+bdwrite(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bdwrite");
+  if(!b->dirty){
+    b->dirty = 1;
+    b->dirtytime = ticks;
+    if(__sync_add_and_fetch(&bcache.ndirty, 1) == bcachesize() / BDIRTYFRAC + 1){
+      // too much is dirty; start the flusher now rather than
+      // at the next tick.  other processes sleeping on ticks
+      // just check the time again.
+      acquire(&bcache.lock);
+      wakeup(&ticks);
+      release(&bcache.lock);
+    }
+  }
+}
+
+// Number of dirty buffers in the cache.
+int
+bdirtycount(void)
+{
+  return bcache.ndirty;
+}
+
+// Put in blk[] the numbers of the lowest BFLUSHMAX blocks
+// of dev from from on whose buffers have been dirty for at
+// least age ticks, in ascending order.  Returns how many.
+// Only a hint: the buffers may be cleaned meanwhile.
+static int
+bdirtyscan(uint dev, uint from, uint age, uint *blk)
+{
+  struct buf *b;
+  int i, j, n = 0;
+
+  for(i = 0; i < NBUCKET; i++){
+    acquire(&bcache.bucket[i].lock);
+    for(b = bcache.bucket[i].head; b; b = b->next){
+      if(!b->dirty || b->dev != dev || b->blockno < from ||
+         ticks - b->dirtytime < age)
+        continue;
+      if(n == BFLUSHMAX && b->blockno > blk[n-1])
+        continue;
+      // insertion sort; a full array drops its last entry.
+      if(n < BFLUSHMAX)
+        n++;
+      for(j = n-1; j > 0 && blk[j-1] > b->blockno; j--)
+        blk[j] = blk[j-1];
+      blk[j] = b->blockno;
+    }
+    release(&bcache.bucket[i].lock);
+  }
+  return n;
+}
+
+// Write the n locked dirty buffers in bs and release them.
+static int
+bflushv(struct buf **bs, int n)
+{
+  int i;
+
+  bwritev(bs, n);
+  for(i = 0; i < n; i++)
+    brelse(bs[i]);
+  __sync_fetch_and_add(&bwritebacks, n);
+  return n;
+}
+
+// Write back the blocks of dev that have been dirty for at
+// least age ticks, or all of them if age is 0, in ascending
+// block order, and wait for the writes.  Returns the number
+// of blocks written.
+int
+bflush(uint dev, uint age)
+{
+  struct buf *bs[BFLUSHMAX], *b;
+  uint blk[BFLUSHMAX], from = 0;
+  int i, n, m, fresh, total = 0;
+
+  while(bcache.ndirty > 0 && (n = bdirtyscan(dev, from, age, blk)) > 0){
+    m = 0;
+    for(i = 0; i < n; i++){
+      b = bref(dev, blk[i], &fresh);
+      if(!tryacquiresleep(&b->lock)){
+        // never sleep on a buffer while holding others,
+        // whose holders might be waiting for this one.
+        total += bflushv(bs, m);
+        m = 0;
+        acquiresleep(&b->lock);
+      }
+      if(b->dirty)
+        bs[m++] = b;
+      else
+        brelse(b);  // written back meanwhile
+    }
+    total += bflushv(bs, m);
+    from = blk[n-1] + 1;
+  }
+  return total;
+}
+
+// Kernel thread that writes back dirty blocks once they are
+// BDIRTYTICKS ticks old, or all of them when more than
+// 1/BDIRTYFRAC of the cache is dirty.
+void
+bflusher(void)
+{
+  for(;;){
+    acquire(&bcache.lock);
+    if(bcache.ndirty <= bcachesize() / BDIRTYFRAC)
+      sleep(&ticks, &bcache.lock);
+    release(&bcache.lock);
+    if(bcache.ndirty == 0)
+      continue;
+    if(bcache.ndirty > bcachesize() / BDIRTYFRAC)
+      bflush(ROOTDEV, 0);
+    else
+      bflush(ROOTDEV, BDIRTYTICKS);
+  }
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
 void
 brelse(struct buf *b)
 {
@@ -120,34 +630,23 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
-
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+  bunref(b);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  int h = bhash(b->dev, b->blockno);
+
+  acquire(&bcache.bucket[h].lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bcache.bucket[h].lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  int h = bhash(b->dev, b->blockno);
+
+  acquire(&bcache.bucket[h].lock);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&bcache.bucket[h].lock);
 }
-
-
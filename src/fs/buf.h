@@ -1,12 +1,15 @@
 struct buf {
-  int valid;   // has data been read from disk?
+  int valid;   // has data been read from disk, or a read started?
   int disk;    // does disk "own" buf?
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  uint lastuse;     // ticks when refcnt last dropped to 0
+  int dirty;        // newer than the disk; see bdwrite()
+  uint dirtytime;   // ticks when it became dirty
+  struct buf *next; // hash bucket chain
+  struct buf *qnext; // next buf in the same disk request
   uchar data[BSIZE];
 };
 
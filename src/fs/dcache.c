@@ -0,0 +1,165 @@
+// Directory name lookup cache.
+//
+// dirlookup() otherwise reads every entry of a directory to
+// resolve one path element.  The cache maps (dev, directory
+// inum, name) to the inum and offset of the entry, or records
+// that the directory has no such name (a negative entry, with
+// inum 0), so that a repeated lookup costs one hash probe.
+//
+// The cache is kept exact rather than merely hinted: every
+// change to a directory's entries goes through dirlink() or
+// sys_unlink(), which update the cache while holding the
+// directory's lock, and iput() purges a directory's entries
+// when it frees the inode, before the inum can be reused.
+// dirlookup() is also called with the directory locked, so it
+// never sees an entry half way through a change.
+//
+// When the cache is full, an entry is recycled with the clock
+// algorithm: a hit sets an entry's referenced bit, and the
+// hand clears bits until it finds an entry without one.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+
+#define NDBUCKET 127
+
+struct dentry {
+  uint dev;
+  uint dir;             // inum of the directory
+  char name[DIRSIZ];
+  uint inum;            // 0 if the directory has no such name
+  uint off;             // offset of the entry in the directory
+  int used;             // holds a name
+  int referenced;       // hit since the clock hand last passed
+  struct dentry *next;  // hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry entry[NDCACHE];
+  struct dentry *bucket[NDBUCKET];
+  int hand;
+} dcache;
+
+// lookups answered from the cache, and those that were not.
+uint64 dcachehits, dcachemisses;
+
+static struct dentry**
+dbucket(uint dev, uint dir, char *name)
+{
+  uint h = dev * 31 + dir;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return &dcache.bucket[h % NDBUCKET];
+}
+
+void
+dcacheinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+// Find the entry for name in dir.  Caller holds dcache.lock.
+static struct dentry*
+dfind(uint dev, uint dir, char *name)
+{
+  struct dentry *d;
+
+  for(d = *dbucket(dev, dir, name); d; d = d->next){
+    if(d->dev == dev && d->dir == dir && strncmp(d->name, name, DIRSIZ) == 0)
+      return d;
+  }
+  return 0;
+}
+
+// Take d out of its hash chain and mark it unused.
+// Caller holds dcache.lock.
+static void
+ddrop(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = dbucket(d->dev, d->dir, d->name); *pp != d; pp = &(*pp)->next)
+    ;
+  *pp = d->next;
+  d->used = 0;
+}
+
+// Look up name in directory dir.  Returns 1 and sets *inum
+// and *off if the cache knows the answer; *inum is 0 if the
+// directory has no such name.  Returns 0 if the cache does
+// not know.
+int
+dcache_lookup(uint dev, uint dir, char *name, uint *inum, uint *off)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dev, dir, name)) != 0){
+    d->referenced = 1;
+    *inum = d->inum;
+    *off = d->off;
+    release(&dcache.lock);
+    __sync_fetch_and_add(&dcachehits, 1);
+    return 1;
+  }
+  release(&dcache.lock);
+  __sync_fetch_and_add(&dcachemisses, 1);
+  return 0;
+}
+
+// Record that name in directory dir is the entry at off for
+// inum, or, if inum is 0, that the directory has no such name.
+// Caller holds the directory's lock.
+void
+dcache_enter(uint dev, uint dir, char *name, uint inum, uint off)
+{
+  struct dentry *d, **pp;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dev, dir, name)) == 0){
+    // recycle an entry the clock hand finds unreferenced.
+    for(;;){
+      d = &dcache.entry[dcache.hand];
+      dcache.hand = (dcache.hand + 1) % NDCACHE;
+      if(!d->used)
+        break;
+      if(!d->referenced){
+        ddrop(d);
+        break;
+      }
+      d->referenced = 0;
+    }
+    d->dev = dev;
+    d->dir = dir;
+    strncpy(d->name, name, DIRSIZ);
+    d->used = 1;
+    d->referenced = 0;
+    pp = dbucket(dev, dir, name);
+    d->next = *pp;
+    *pp = d;
+  }
+  d->inum = inum;
+  d->off = off;
+  release(&dcache.lock);
+}
+
+// Forget every name in directory dir, which is being freed.
+void
+dcache_purge(uint dev, uint dir)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.entry; d < &dcache.entry[NDCACHE]; d++){
+    if(d->used && d->dev == dev && d->dir == dir)
+      ddrop(d);
+  }
+  release(&dcache.lock);
+}
@@ -128,6 +128,7 @@ int
 fileread(struct file *f, uint64 addr, int n)
 {
   int r = 0;
+  uint want, ready;
 
   // 检查文件是否可读
   if(f->readable == 0)
@@ -144,9 +145,21 @@ fileread(struct file *f, uint64 addr, int n)
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
     // 从inode文件读取
+    // 持有inode锁时复制不能缺页去读另一个可执行文件（见uvmfaultin()），
+    // 所以先在锁外准备好将要读出的字节所在的页面，只读这么多。
+    ilock(f->ip);
+    want = 0;
+    if(n > 0 && f->off < f->ip->size)
+      want = f->ip->size - f->off;
+    if(want > n)
+      want = n;
+    iunlock(f->ip);
+    ready = uvmfaultin(myproc()->pagetable, addr, want, 1);
+    if(ready == 0 && want > 0)
+      return -1;
     ilock(f->ip);
     // 从当前偏移量处读取数据
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
+    if((r = readi(f->ip, 1, addr, f->off, ready)) > 0)
       f->off += r; // 更新文件偏移量
     iunlock(f->ip);
   } else {
@@ -178,21 +191,26 @@ filewrite(struct file *f, uint64 addr, int n)
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
     // 向inode文件写入
-    // 一次写入几个块以避免超过最大日志事务大小，
-    // 包括i-node、间接块、分配块，
-    // 以及2个块的不对齐写入余量。
+    // 一次写入几个块以避免超过最大日志事务大小。
+    // 每批只预留它实际可能写的日志块：
+    // 数据块（不对齐时多跨1块），加上i-node、
+    // 3个映射块（三级间接块，或extent的新旧叶子块）和2个位图块。
     // 这实际上应该在更低层，因为writei()
     // 可能正在写入像控制台这样的设备。
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+    int max = (MAXOPBLOCKS-1-1-3-2) * BSIZE;
     int i = 0;
     // 分批写入数据
     while(i < n){
       int n1 = n - i;
       if(n1 > max)
         n1 = max;
+      // 同fileread()，持锁之前准备好本批的用户页面
+      n1 = uvmfaultin(myproc()->pagetable, addr + i, n1, 0);
+      if(n1 == 0)
+        break;
 
-      // 开始操作事务
-      begin_op();
+      // 开始操作事务，按本批的块数预留日志空间
+      begin_opn((n1 + BSIZE - 1) / BSIZE + 1 + 1 + 3 + 2);
       ilock(f->ip);
       // 写入数据并更新文件偏移量
       if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
@@ -18,15 +18,26 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *next; // hash chain, or itable's empty list
+  struct inode *lruprev, *lrunext; // unreferenced valid inodes
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
   short type;         // copy of disk inode
+  uchar flags;
   short major;
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+3];
+
+  uint ra_next;       // block where the last readi() ended
+  uint ra_end;        // blocks before this have been read ahead
+  uint ra_win;        // read-ahead window in blocks, 0 if random
+  uint lastblock;     // block most recently allocated to this file
+  struct extent xlast; // run of blocks bmap() found last, if len > 0
+  uint indbase;       // first file block mapped by indblk
+  uint indblk;        // last-level indirect block bmap() used last, or 0
 };
 
 // map major device number to device functions.
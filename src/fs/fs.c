@@ -13,6 +13,7 @@
 #include "riscv.h"
 #include "defs.h"
 #include "param.h"
+#include "memlayout.h"
 #include "stat.h"
 #include "spinlock.h"
 #include "proc.h"
@@ -22,10 +23,23 @@
 #include "file.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
+
+// readi()读到未分配的块时复制的全零数据
+static uchar zeroes[BSIZE];
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb;
 
+// 块分配器的内存状态。位图本身仍由其缓冲区的睡眠锁保护，
+// 这里只记录下一次从哪里开始找，以及还剩多少空闲块。
+struct {
+  struct spinlock lock;
+  uint next;   // next-fit游标：上一次分配的块之后
+  uint nfree;  // 空闲块数，为0时balloc直接失败
+} bfreemap;
+
+static void bcount(int dev);
+
 /// @brief 读取超级块
 static void
 readsb(int dev, struct superblock *sb)
@@ -47,8 +61,16 @@ void fsinit(int dev)
   // 检查文件系统魔数是否正确
   if (sb.magic != FSMAGIC)
     panic("invalid file system");
+  if (sizeof(struct exthdr) + NIEXTENT * sizeof(struct extent) >
+      sizeof(((struct dinode *)0)->addrs))
+    panic("fsinit: extents");
   // 初始化日志系统
   initlog(dev, &sb);
+  // 日志恢复之后位图才是准确的，再统计空闲块
+  bcount(dev);
+  // 启动后台写回线程
+  if (kthread_create(bflusher, "bflush") < 0)
+    panic("fsinit: bflusher");
 }
 
 /** Block层操作
@@ -76,32 +98,95 @@ bzero(int dev, int bno)
   brelse(bp);
 }
 
+/// @brief 统计位图中的空闲块数，并初始化next-fit游标。
+/// 整个64位字都已分配时一次跳过。
+/// @param dev 设备号
+static void
+bcount(int dev)
+{
+  struct buf *bp;
+  uint64 *w;
+  uint b, wi, bit, n;
+
+  initlock(&bfreemap.lock, "bfreemap");
+  n = 0;
+  for (b = 0; b < sb.size; b += BPB)
+  {
+    bp = bread(dev, BBLOCK(b, sb));
+    // data紧跟在struct buf的指针成员之后，按8字节对齐
+    w = (uint64 *)bp->data;
+    for (wi = 0; wi < BPB / 64 && b + wi * 64 < sb.size; wi++)
+    {
+      if (w[wi] == ~0ULL)
+        continue;
+      for (bit = 0; bit < 64 && b + wi * 64 + bit < sb.size; bit++)
+        if ((w[wi] & (1ULL << bit)) == 0)
+          n++;
+    }
+    brelse(bp);
+  }
+  bfreemap.nfree = n;
+  bfreemap.next = 0;
+}
+
 /// @brief 分配一个新的磁盘块，并将其内容初始化为零。
+/// 从goal开始向后找第一个空闲块（next-fit），到末尾后从头绕回；
+/// 位图按64位字扫描，全满的字一次跳过。
 /// @param dev 指定的设备号
+/// @param goal 希望分配到的块号，通常是同一文件上一块之后；0表示从游标开始
 /// @return 返回分配的块号，如果没有可用的块则返回0
 static uint
-balloc(uint dev)
+balloc(uint dev, uint goal)
 {
-  int b, bi, m;
+  uint nbm, start, i, bmi, wi, w0, bit, b;
+  uint64 *w, x;
   struct buf *bp;
 
-  bp = 0;
-  for (b = 0; b < sb.size; b += BPB)
+  acquire(&bfreemap.lock);
+  if (bfreemap.nfree == 0)
   {
-    bp = bread(dev, BBLOCK(b, sb));
-    // 这个循环用于在位图块中查找一个空闲的块
-    for (bi = 0; bi < BPB && b + bi < sb.size; bi++)
+    // 无需扫描位图就知道磁盘已满
+    release(&bfreemap.lock);
+    printf("balloc: out of blocks\n");
+    return 0;
+  }
+  if (goal == 0 || goal >= sb.size)
+    goal = bfreemap.next;
+  release(&bfreemap.lock);
+  if (goal >= sb.size)
+    goal = 0;
+
+  nbm = (sb.size + BPB - 1) / BPB;
+  start = goal / BPB;
+  // 最后一轮回到起始位图块，检查goal之前的部分
+  for (i = 0; i <= nbm; i++)
+  {
+    bmi = (start + i) % nbm;
+    bp = bread(dev, BBLOCK(bmi * BPB, sb));
+    w = (uint64 *)bp->data;
+    w0 = (i == 0) ? (goal % BPB) / 64 : 0;
+    for (wi = w0; wi < BPB / 64; wi++)
     {
-      m = 1 << (bi % 8);
-      if ((bp->data[bi / 8] & m) == 0)
-      {                        // Is block free?
-        bp->data[bi / 8] |= m; // 在data的相应位置上设置为1，表示该块已被分配
-        // 对块进行修改后记得bget对应的写回和资源释放
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+      x = ~w[wi];
+      if (i == 0 && wi == w0)
+        x &= ~0ULL << (goal % 64); // 第一个字只看goal及之后
+      if (x == 0)
+        continue; // 这64块都已分配
+      for (bit = 0; (x & (1ULL << bit)) == 0; bit++)
+        ;
+      b = bmi * BPB + wi * 64 + bit;
+      if (b >= sb.size)
+        break; // 位图末尾超出磁盘的部分
+      w[wi] |= 1ULL << bit; // 设置为1，表示该块已被分配
+      // 对块进行修改后记得bget对应的写回和资源释放
+      log_write(bp);
+      brelse(bp);
+      acquire(&bfreemap.lock);
+      bfreemap.nfree--;
+      bfreemap.next = b + 1;
+      release(&bfreemap.lock);
+      bzero(dev, b);
+      return b;
     }
     // 记得bget对应的资源释放
     brelse(bp);
@@ -130,6 +215,24 @@ bfree(int dev, uint b)
   // 写回
   log_write(bp);
   brelse(bp);
+  acquire(&bfreemap.lock);
+  bfreemap.nfree++;
+  release(&bfreemap.lock);
+}
+
+/// @brief 为inode ip分配一个新块，尽量紧跟在它上一次分配的块之后，
+/// 使同一文件的连续块在磁盘上也连续。
+/// @param ip 调用者持有ip的锁
+/// @return 返回分配的块号，如果没有可用的块则返回0
+static uint
+iballoc(struct inode *ip)
+{
+  uint addr;
+
+  addr = balloc(ip->dev, ip->lastblock ? ip->lastblock + 1 : 0);
+  if (addr)
+    ip->lastblock = addr;
+  return addr;
 }
 
 /**以下是Inode层操作 */
@@ -162,7 +265,9 @@ bfree(int dev, uint b)
 // * 有效：inode 表条目中的信息（类型、大小等）
 //   只有在 ip->valid 为 1 时才是正确的。
 //   ilock() 从磁盘读取 inode 并设置 ip->valid，
-//   而 iput() 在 ip->ref 降为零时清除 ip->valid。
+//   而 iput() 在释放磁盘 inode 时清除 ip->valid。
+//   ip->ref 降为零但仍有效的条目留在表中，
+//   再次 iget() 同一个 inode 时 ilock() 无需读盘。
 //
 // * 锁定：文件系统代码只有在首先锁定 inode 后，
 //   才能检查和修改 inode 及其内容中的信息。
@@ -185,34 +290,184 @@ bfree(int dev, uint b)
 // 已经锁定了相关 inode；这使得调用者可以
 // 创建多步骤的原子操作。
 //
+// inode 表是以 (dev, inum) 为键的哈希表。表从 NINODE 个
+// 条目开始，条目不够时从 kalloc() 按页增长，最多占用
+// 物理内存的 1/ICACHEFRAC；kalloc() 内存不足时调用
+// ishrink() 归还条目全部未被引用的页。
+// ip->ref 为零的有效条目按释放顺序串在 LRU 链表上，
+// 表不能再增长时，iget() 回收其中最久未用的一个。
+//
 // itable.lock 自旋锁保护 itable 条目的分配。
 // 由于 ip->ref 表示一个条目是否空闲，
 // 而 ip->dev 和 ip->inum 表示条目所持有的 inode，
 // 因此在使用这些字段时，必须持有 itable.lock。
+// 它同样保护哈希链、空闲链表和 LRU 链表。
 //
-// ip->lock 睡眠锁保护除 ref、dev 和 inum 外的所有 ip-> 字段。
+// ip->lock 睡眠锁保护除 ref、dev、inum 和链表指针外的所有 ip-> 字段。
 // 必须持有 ip->lock 才能读取或写入 inode 的
 // ip->valid、ip->size、ip->type 等字段。
 
+#define NIBUCKET 61
+#define ISHRINK  16 // ishrink() 每次最多归还的页数
+
+// 表增长时分配的一页 inode
+#define IPERPAGE ((PGSIZE - sizeof(struct ipage *)) / sizeof(struct inode))
+struct ipage
+{
+  struct inode inode[IPERPAGE];
+  struct ipage *next;
+};
+
 // 内核维护的 inode 表
 struct
 {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct inode *bucket[NIBUCKET]; // 以 (dev, inum) 为键的哈希链
+  struct inode *empty;            // 不持有任何 inode 的条目，dev 为 0
+  struct inode *lruhead;          // 未被引用的有效条目，最久未用的在前
+  struct inode *lrutail;
+  struct ipage *pages;            // igrow() 分配的页
+  int npages;
+  int maxpages;
 } itable;
 
+// iget() 在表中找到的 inode 数，以及 ilock() 从磁盘读取 inode 的次数
+uint64 icachehits, ireads;
+
+static struct inode **
+ibucket(uint dev, uint inum)
+{
+  return &itable.bucket[(dev * 31 + inum) % NIBUCKET];
+}
+
 /// @brief 初始化 inode 表，主要是初始化锁
 void iinit()
 {
   int i = 0;
 
+  if (sizeof(struct ipage) > PGSIZE)
+    panic("iinit: ipage");
+
   // 初始化inode表锁
   initlock(&itable.lock, "itable");
-  // 为每个inode初始化睡眠锁
+  itable.maxpages = (PHYSTOP - KERNBASE) / PGSIZE / ICACHEFRAC;
+  // 为每个inode初始化睡眠锁，并放入空闲链表
   for (i = 0; i < NINODE; i++)
   {
     initsleeplock(&itable.inode[i].lock, "inode");
+    itable.inode[i].next = itable.empty;
+    itable.empty = &itable.inode[i];
+  }
+}
+
+/// @brief 表中的条目数，供 kstat() 使用
+int icachesize(void)
+{
+  return NINODE + itable.npages * IPERPAGE;
+}
+
+/// @brief 把 ip 从 LRU 链表中取下。调用者持有 itable.lock。
+static void
+lruremove(struct inode *ip)
+{
+  if (ip->lruprev)
+    ip->lruprev->lrunext = ip->lrunext;
+  else
+    itable.lruhead = ip->lrunext;
+  if (ip->lrunext)
+    ip->lrunext->lruprev = ip->lruprev;
+  else
+    itable.lrutail = ip->lruprev;
+  ip->lruprev = ip->lrunext = 0;
+}
+
+/// @brief 把 ip 从所在的哈希链或空闲链表中取下。调用者持有 itable.lock。
+static void
+iunhash(struct inode *ip)
+{
+  struct inode **pp;
+
+  if (ip->dev == 0)
+    pp = &itable.empty;
+  else
+    pp = ibucket(ip->dev, ip->inum);
+  for (; *pp != ip; pp = &(*pp)->next)
+    ;
+  *pp = ip->next;
+}
+
+/// @brief 为表增加一页 inode 条目。
+/// 调用者持有 itable.lock；kalloc() 可能调用 bshrink() 等回收函数，
+/// 所以分配期间暂时释放 itable.lock，别的CPU可能已经插入了同一个
+/// inode，调用者须重新查找。
+/// @return 1 表增长了；0 释放过锁但没有增长；-1 已到上限，没有释放锁
+static int
+igrow(void)
+{
+  struct ipage *pg;
+  struct inode *ip;
+
+  if (itable.npages >= itable.maxpages)
+    return -1;
+  release(&itable.lock);
+  pg = (struct ipage *)kalloc();
+  acquire(&itable.lock);
+  if (pg == 0)
+    return 0;
+  // 释放锁期间别的CPU可能也增长了表
+  if (itable.npages >= itable.maxpages)
+  {
+    kfree(pg);
+    return 0;
+  }
+  memset(pg, 0, sizeof(*pg));
+  for (ip = pg->inode; ip < &pg->inode[IPERPAGE]; ip++)
+  {
+    initsleeplock(&ip->lock, "inode");
+    ip->next = itable.empty;
+    itable.empty = ip;
+  }
+  pg->next = itable.pages;
+  itable.pages = pg;
+  itable.npages++;
+  return 1;
+}
+
+/// @brief 归还条目全部未被引用的页，由 kalloc() 在内存不足时调用。
+/// 被丢弃的有效条目只是缓存，下次 iget() 时重新从磁盘读取。
+/// @return 归还的页数
+int ishrink(void)
+{
+  struct ipage *pg, **pp;
+  struct inode *ip;
+  int n = 0;
+
+  acquire(&itable.lock);
+  pp = &itable.pages;
+  while ((pg = *pp) != 0 && n < ISHRINK)
+  {
+    for (ip = pg->inode; ip < &pg->inode[IPERPAGE]; ip++)
+      if (ip->ref != 0)
+        break;
+    if (ip < &pg->inode[IPERPAGE])
+    {
+      pp = &pg->next;
+      continue;
+    }
+    for (ip = pg->inode; ip < &pg->inode[IPERPAGE]; ip++)
+    {
+      if (ip->valid)
+        lruremove(ip);
+      iunhash(ip);
+    }
+    *pp = pg->next;
+    itable.npages--;
+    kfree(pg);
+    n++;
   }
+  release(&itable.lock);
+  return n;
 }
 
 static struct inode *iget(uint dev, uint inum);
@@ -237,6 +492,8 @@ ialloc(uint dev, short type)
     { // a free inode
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
+      if (sb.features & FS_EXTENTS)
+        dip->flags = DI_EXTENTS;
       log_write(bp); // mark it allocated on the disk
       // 释放缓冲区
       brelse(bp);
@@ -261,6 +518,7 @@ void iupdate(struct inode *ip)
   // 获取磁盘inode指针
   dip = (struct dinode *)bp->data + ip->inum % IPB;
   dip->type = ip->type;
+  dip->flags = ip->flags;
   dip->major = ip->major;
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
@@ -281,36 +539,53 @@ void iupdate(struct inode *ip)
 static struct inode *
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **pp;
+  int grow = 1, r;
 
   acquire(&itable.lock);
 
+again:
   // 检查inode是否已经在表中
-  empty = 0;
-  for (ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++)
+  pp = ibucket(dev, inum);
+  for (ip = *pp; ip; ip = ip->next)
   {
-    if (ip->ref > 0 && ip->dev == dev && ip->inum == inum)
+    if (ip->dev == dev && ip->inum == inum)
     {
-      // 找到匹配的inode，增加引用计数
+      // 找到匹配的inode，增加引用计数；
+      // 未被引用的条目离开 LRU 链表，内容仍然有效
+      if (ip->ref == 0 && ip->valid)
+        lruremove(ip);
       ip->ref++;
       release(&itable.lock);
+      __sync_fetch_and_add(&icachehits, 1);
       return ip;
     }
-    // 记住空闲槽位
-    if (empty == 0 && ip->ref == 0) // Remember empty slot.
-      empty = ip;
   }
 
-  // 回收一个inode表项
-  if (empty == 0)
+  // 取一个空闲条目；没有则增长表，再不行就回收最久未用的条目。
+  // igrow() 释放过锁时，不论成败都要重新查找；分配失败后不再试。
+  if (itable.empty == 0 && grow && (r = igrow()) >= 0)
+  {
+    grow = r;
+    goto again;
+  }
+  if ((ip = itable.empty) != 0)
+    itable.empty = ip->next;
+  else if ((ip = itable.lruhead) != 0)
+  {
+    lruremove(ip);
+    iunhash(ip);
+  }
+  else
     panic("iget: no inodes");
 
   // 初始化新的inode表项
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->next = *pp;
+  *pp = ip;
   release(&itable.lock);
 
   return ip;
@@ -341,15 +616,25 @@ void ilock(struct inode *ip)
   // 如果inode无效，从磁盘读取
   if (ip->valid == 0)
   {
+    __sync_fetch_and_add(&ireads, 1);
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
     dip = (struct dinode *)bp->data + ip->inum % IPB;
     // 从磁盘inode复制到内存inode
     ip->type = dip->type;
+    ip->flags = dip->flags;
     ip->major = dip->major;
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    ip->ra_next = ip->ra_end = ip->ra_win = 0;
+    // 新块的分配目标：最后一个已分配的直接块之后
+    ip->lastblock = 0;
+    for (int i = 0; i < NDIRECT && !(ip->flags & DI_EXTENTS); i++)
+      if (ip->addrs[i])
+        ip->lastblock = ip->addrs[i];
+    ip->xlast.len = 0;
+    ip->indblk = 0;
     // 释放缓冲区
     brelse(bp);
     // 标记为有效
@@ -388,6 +673,9 @@ void iput(struct inode *ip)
 
     release(&itable.lock);
 
+    // 目录的inode号即将被重用，忘掉缓存的目录项
+    if (ip->type == T_DIR)
+      dcache_purge(ip->dev, ip->inum);
     // 截断inode，释放其数据块
     itrunc(ip);
     ip->type = 0;
@@ -400,8 +688,28 @@ void iput(struct inode *ip)
     acquire(&itable.lock);
   }
 
-  // 减少引用计数
-  ip->ref--;
+  // 减少引用计数。最后一个引用释放后，有效的条目进入 LRU 链表尾部
+  // 以便再次使用，无效的条目回到空闲链表。
+  if (--ip->ref == 0)
+  {
+    if (ip->valid)
+    {
+      ip->lruprev = itable.lrutail;
+      ip->lrunext = 0;
+      if (itable.lrutail)
+        itable.lrutail->lrunext = ip;
+      else
+        itable.lruhead = ip;
+      itable.lrutail = ip;
+    }
+    else
+    {
+      iunhash(ip);
+      ip->dev = 0;
+      ip->next = itable.empty;
+      itable.empty = ip;
+    }
+  }
   release(&itable.lock);
 }
 
@@ -419,69 +727,378 @@ void iunlockput(struct inode *ip)
 // 前NDIRECT个块号列在ip->addrs[]中。
 // 接下来的NINDIRECT个块列在块ip->addrs[NDIRECT]中。
 
+/** extent映射
+ *  带DI_EXTENTS标志的inode用(lblk, pblk, len)的连续区间映射文件块，
+ *  格式见fs.h。顺序访问时bmap几乎总是命中ip->xlast，
+ *  不需要读任何映射块；分配新块时尽量接在最后一个extent之后，
+ *  使其长度加一，这样连续的文件块在磁盘上也连续。
+ *  文件只在末尾增长（writei不允许空洞），所以新extent总是追加在最后。
+ */
+
+static struct exthdr *
+ihdr(struct inode *ip)
+{
+  return (struct exthdr *)ip->addrs;
+}
+
+static struct extent *
+iext(struct inode *ip)
+{
+  return (struct extent *)(ihdr(ip) + 1);
+}
+
+/// @brief 在按lblk排序的n个extent中二分查找bn。
+/// @param index 非0时e是索引项，返回最后一个lblk<=bn的项
+/// @return 返回下标，找不到返回-1
+static int
+extfind(struct extent *e, int n, uint bn, int index)
+{
+  int lo = 0, hi = n - 1, mid, r = -1;
+
+  while (lo <= hi)
+  {
+    mid = (lo + hi) / 2;
+    if (e[mid].lblk <= bn)
+    {
+      r = mid;
+      lo = mid + 1;
+    }
+    else
+      hi = mid - 1;
+  }
+  if (r >= 0 && !index && bn - e[r].lblk >= e[r].len)
+    r = -1;
+  return r;
+}
+
+/// @brief 为extent映射的inode在文件末尾分配第bn块。
+/// 当前位置（inode或最后一个叶子块）满了时，深度0的inode把它的
+/// extent搬进一个新叶子块变成深度1；深度1的inode再加一个叶子块。
+/// @return 返回分配的块号，磁盘满或extent树满时返回0
+static uint
+extappend(struct inode *ip, uint bn)
+{
+  struct exthdr *h = ihdr(ip), *lh = h;
+  struct extent *e = iext(ip), *le = e, *last;
+  struct buf *bp = 0;
+  uint addr, leaf, max = NIEXTENT;
+
+  // 找到最后一个extent，深度1时它在最后一个叶子块里
+  if (h->depth == 1)
+  {
+    bp = bread(ip->dev, e[h->n - 1].pblk);
+    lh = (struct exthdr *)bp->data;
+    le = (struct extent *)(lh + 1);
+    max = NLEXTENT;
+  }
+  last = lh->n > 0 ? &le[lh->n - 1] : 0;
+  if (last && bn < last->lblk + last->len)
+    panic("extappend: hole");
+
+  addr = balloc(ip->dev, last ? last->pblk + last->len : 0);
+  if (addr == 0)
+    goto out;
+  if (last && last->lblk + last->len == bn && last->pblk + last->len == addr)
+  {
+    // 紧接在最后一个extent之后，直接加长
+    last->len++;
+    ip->xlast = *last;
+    goto done;
+  }
+
+  if (lh->n == max)
+  {
+    // 需要一个新叶子块
+    if (h->depth == 1 && h->n == NIEXTENT)
+    {
+      // extent树已满
+      bfree(ip->dev, addr);
+      addr = 0;
+      goto out;
+    }
+    if ((leaf = balloc(ip->dev, 0)) == 0)
+    {
+      bfree(ip->dev, addr);
+      addr = 0;
+      goto out;
+    }
+    if (bp)
+      brelse(bp);
+    bp = bread(ip->dev, leaf); // balloc已清零
+    lh = (struct exthdr *)bp->data;
+    le = (struct extent *)(lh + 1);
+    if (h->depth == 0)
+    {
+      // inode中的extent搬进叶子块
+      memmove(le, e, h->n * sizeof(*e));
+      lh->n = h->n;
+      h->depth = 1;
+      h->n = 0;
+    }
+    e[h->n].lblk = lh->n > 0 ? le[0].lblk : bn;
+    e[h->n].pblk = leaf;
+    e[h->n].len = 0;
+    h->n++;
+  }
+  le[lh->n].lblk = bn;
+  le[lh->n].pblk = addr;
+  le[lh->n].len = 1;
+  ip->xlast = le[lh->n];
+  lh->n++;
+
+done:
+  // inode本身的改变由writei()的iupdate()写回
+  if (bp)
+    log_write(bp);
+out:
+  if (bp)
+    brelse(bp);
+  return addr;
+}
+
+/// @brief bmap()的extent版本。
+static uint
+extbmap(struct inode *ip, uint bn, int alloc)
+{
+  struct exthdr *h = ihdr(ip), *lh;
+  struct extent *e = iext(ip), *le;
+  struct buf *bp;
+  int i;
+
+  // 顺序访问通常落在上一次找到的extent里
+  if (ip->xlast.len > 0 && bn - ip->xlast.lblk < ip->xlast.len)
+    return ip->xlast.pblk + (bn - ip->xlast.lblk);
+
+  if (h->depth == 0)
+  {
+    if ((i = extfind(e, h->n, bn, 0)) >= 0)
+    {
+      ip->xlast = e[i];
+      return e[i].pblk + (bn - e[i].lblk);
+    }
+  }
+  else if ((i = extfind(e, h->n, bn, 1)) >= 0)
+  {
+    bp = bread(ip->dev, e[i].pblk);
+    lh = (struct exthdr *)bp->data;
+    le = (struct extent *)(lh + 1);
+    if ((i = extfind(le, lh->n, bn, 0)) >= 0)
+    {
+      ip->xlast = le[i];
+      brelse(bp);
+      return ip->xlast.pblk + (bn - ip->xlast.lblk);
+    }
+    brelse(bp);
+  }
+  if (!alloc)
+    return 0;
+  return extappend(ip, bn);
+}
+
+/// @brief 释放n个extent映射的所有数据块。
+static void
+extfree(uint dev, struct extent *e, int n)
+{
+  int i;
+  uint k;
+
+  for (i = 0; i < n; i++)
+    for (k = 0; k < e[i].len; k++)
+      bfree(dev, e[i].pblk + k);
+}
+
+/// @brief itrunc()的extent版本。
+static void
+exttrunc(struct inode *ip)
+{
+  struct exthdr *h = ihdr(ip), *lh;
+  struct extent *e = iext(ip);
+  struct buf *bp;
+  int i;
+
+  if (h->depth == 0)
+  {
+    extfree(ip->dev, e, h->n);
+  }
+  else
+  {
+    for (i = 0; i < h->n; i++)
+    {
+      bp = bread(ip->dev, e[i].pblk);
+      lh = (struct exthdr *)bp->data;
+      extfree(ip->dev, (struct extent *)(lh + 1), lh->n);
+      brelse(bp);
+      bfree(ip->dev, e[i].pblk);
+    }
+  }
+  memset(ip->addrs, 0, sizeof(ip->addrs));
+  ip->xlast.len = 0;
+}
+
 /// @brief 返回inode ip中第n个块的磁盘块地址。
-/// 如果没有这样的块，bmap会分配一个。
+/// 如果没有这样的块，alloc非0时bmap会分配一个，否则返回0。
 /// 如果磁盘空间不足则返回0。
+/// 间接映射时，bmap记住最后一层间接块（ip->indblk），以及从它读出的
+/// 一段连续的块（ip->xlast），所以顺序访问时通常不需要bread，
+/// 即使需要也只读最后一层，不必从顶层逐层往下读。
 static uint
-bmap(struct inode *ip, uint bn)
+bmap(struct inode *ip, uint bn, int alloc)
 {
-  uint addr, *a;
+  uint addr, next, r, span, level, n, *a;
   struct buf *bp;
 
+  if (ip->flags & DI_EXTENTS)
+    return extbmap(ip, bn, alloc);
+
   // 直接块
   if (bn < NDIRECT)
   {
     // 如果该直接块未分配，分配一个
-    if ((addr = ip->addrs[bn]) == 0)
+    if ((addr = ip->addrs[bn]) == 0 && alloc)
     {
-      addr = balloc(ip->dev);
+      addr = iballoc(ip);
       if (addr == 0)
         return 0;
       ip->addrs[bn] = addr;
     }
     return addr;
   }
-  bn -= NDIRECT;
 
-  // 间接块
-  if (bn < NINDIRECT)
+  // 上一次找到的连续区间
+  if (ip->xlast.len > 0 && bn - ip->xlast.lblk < ip->xlast.len)
+    return ip->xlast.pblk + (bn - ip->xlast.lblk);
+
+  // 算出bn在第几层间接块（1、2、3）下面，以及在该层中的序号r
+  r = bn - NDIRECT;
+  for (level = 1, span = NINDIRECT; r >= span; level++, span *= NINDIRECT)
   {
-    // 加载间接块，如果需要则分配
-    if ((addr = ip->addrs[NDIRECT]) == 0)
+    if (level == 3)
+      panic("bmap: out of range");
+    r -= span;
+  }
+
+  if (ip->indblk && bn - ip->indbase < NINDIRECT)
+  {
+    // 上一次用过的最后一层间接块
+    addr = ip->indblk;
+    r = bn - ip->indbase;
+  }
+  else
+  {
+    // 加载顶层间接块，如果需要则分配
+    if ((addr = ip->addrs[NDIRECT + level - 1]) == 0)
     {
-      addr = balloc(ip->dev);
+      if (!alloc)
+        return 0;
+      addr = iballoc(ip);
       if (addr == 0)
         return 0;
-      ip->addrs[NDIRECT] = addr;
+      ip->addrs[NDIRECT + level - 1] = addr;
     }
-    // 读取间接块
-    bp = bread(ip->dev, addr);
-    a = (uint *)bp->data;
-    // 检查间接块中的目标块是否已分配
-    if ((addr = a[bn]) == 0)
+    // 逐层往下，直到最后一层间接块
+    for (; level > 1; level--)
     {
-      addr = balloc(ip->dev);
-      if (addr)
+      span /= NINDIRECT; // 本层每一项映射的块数
+      bp = bread(ip->dev, addr);
+      a = (uint *)bp->data;
+      if ((next = a[r / span]) == 0 && alloc)
       {
-        a[bn] = addr;
-        log_write(bp);
+        next = iballoc(ip);
+        if (next)
+        {
+          a[r / span] = next;
+          log_write(bp);
+        }
       }
+      brelse(bp);
+      if (next == 0)
+        return 0;
+      addr = next;
+      r %= span;
     }
-    // 释放间接块缓冲区
-    brelse(bp);
-    return addr;
+    ip->indbase = bn - r;
+    ip->indblk = addr;
+  }
+
+  // 读取最后一层间接块
+  bp = bread(ip->dev, addr);
+  a = (uint *)bp->data;
+  // 检查间接块中的目标块是否已分配
+  if ((addr = a[r]) == 0)
+  {
+    if (alloc)
+      addr = iballoc(ip);
+    if (addr)
+    {
+      a[r] = addr;
+      log_write(bp);
+    }
+  }
+  else
+  {
+    // 记住从bn开始磁盘上连续的一段
+    for (n = 1; r + n < NINDIRECT && a[r + n] == addr + n; n++)
+      ;
+    ip->xlast.lblk = bn;
+    ip->xlast.pblk = addr;
+    ip->xlast.len = n;
   }
+  // 释放间接块缓冲区
+  brelse(bp);
+  return addr;
+}
+
+/// @brief 释放间接块addr，以及它下面level层内的所有块。
+static void
+ifree(struct inode *ip, uint addr, int level)
+{
+  struct buf *bp;
+  uint *a;
+  int j;
 
-  panic("bmap: out of range");
+  bp = bread(ip->dev, addr);
+  a = (uint *)bp->data;
+  // 释放间接块中指向的所有块
+  for (j = 0; j < NINDIRECT; j++)
+  {
+    if (a[j] == 0)
+      continue;
+    if (level > 1)
+      ifree(ip, a[j], level - 1);
+    else
+      bfree(ip->dev, a[j]);
+  }
+  // 释放间接块缓冲区
+  brelse(bp);
+  // 释放间接块本身
+  bfree(ip->dev, addr);
+}
+
+/// @brief 截断ip最多写入的日志块数：i-node所在的块，加上位图块。
+/// 数据块和间接块（或extent叶子块）每个最多弄脏一个位图块，
+/// 所以大文件以位图块的总数为上限。
+/// 调用者必须持有ip->lock。
+int itruncblocks(struct inode *ip)
+{
+  uint nb = (ip->size + BSIZE - 1) / BSIZE;
+  uint nbm = (sb.size + BPB - 1) / BPB;
+
+  nb += nb / NINDIRECT + 4; // 间接块或extent叶子块
+  return 1 + (nb < nbm ? nb : nbm);
 }
 
 /// @brief 截断inode（丢弃内容）。
+/// 写入的日志块数见itruncblocks()。
 /// 调用者必须持有ip->lock。
 void itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i;
+
+  if (ip->flags & DI_EXTENTS)
+  {
+    exttrunc(ip);
+    goto done;
+  }
 
   // 释放所有直接块
   for (i = 0; i < NDIRECT; i++)
@@ -493,27 +1110,25 @@ void itrunc(struct inode *ip)
     }
   }
 
-  // 如果有间接块，释放间接块中的所有块
-  if (ip->addrs[NDIRECT])
+  // 释放一、二、三级间接块以及它们映射的所有块
+  for (i = 0; i < 3; i++)
   {
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint *)bp->data;
-    // 释放间接块中指向的所有块
-    for (j = 0; j < NINDIRECT; j++)
+    if (ip->addrs[NDIRECT + i])
     {
-      if (a[j])
-        bfree(ip->dev, a[j]);
+      ifree(ip, ip->addrs[NDIRECT + i], i + 1);
+      ip->addrs[NDIRECT + i] = 0;
     }
-    // 释放间接块缓冲区
-    brelse(bp);
-    // 释放间接块本身
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
   }
+  ip->xlast.len = 0;
+  ip->indblk = 0;
 
+done:
   // 重置文件大小并更新inode
   ip->size = 0;
   iupdate(ip);
+
+  // 缓存的程序页面已经失效
+  textinval(ip->dev, ip->inum);
 }
 
 /// @brief 从inode复制stat信息。
@@ -527,6 +1142,57 @@ void stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+/// @brief 顺序读预取。
+/// 如果这次读取从上次读取结束的块开始，就认为访问是顺序的，
+/// 预取窗口从RAMIN开始每次加倍，直到RAMAX；随机访问时窗口
+/// 收缩为0。预取的块通过breadahead()异步读入缓冲区缓存，
+/// 随后的bread()就能命中。只预取文件大小以内的块。
+/// 调用者必须持有ip->lock。
+static void readahead(struct inode *ip, uint off, uint n)
+{
+  uint first = off / BSIZE;
+  uint last = (off + n - 1) / BSIZE;
+  uint nblocks = (ip->size + BSIZE - 1) / BSIZE;
+  uint bn, end, addr;
+  uint addrs[RAMAX];
+  int k;
+
+  if (first != ip->ra_next)
+  {
+    // 随机访问：收缩窗口
+    ip->ra_win = 0;
+    ip->ra_end = 0;
+  }
+  else if (ip->ra_win == 0)
+  {
+    ip->ra_win = RAMIN;
+  }
+  ip->ra_next = (off + n) / BSIZE;
+
+  if (ip->ra_win == 0)
+    return;
+  // 已预取的部分还多于半个窗口时，先不预取，凑成一批再发
+  if (ip->ra_end > last + ip->ra_win / 2)
+    return;
+
+  end = last + 1 + ip->ra_win;
+  if (end > nblocks)
+    end = nblocks;
+  bn = ip->ra_end > first ? ip->ra_end : first;
+  for (k = 0; bn < end && k < RAMAX; bn++)
+  {
+    if ((addr = bmap(ip, bn, 0)) == 0)
+      break;
+    addrs[k++] = addr;
+  }
+  ip->ra_end = bn;
+  breadahead(ip->dev, addrs, k);
+
+  // 访问保持顺序，窗口加倍
+  if (ip->ra_win < RAMAX)
+    ip->ra_win *= 2;
+}
+
 /// @brief 从inode读取数据。
 /// 调用者必须持有ip->lock。
 /// 如果user_dst==1，则dst是用户虚拟地址；否则，dst是内核地址。
@@ -542,17 +1208,29 @@ int readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   if (off + n > ip->size)
     n = ip->size - off;
 
+  // 预取即将读取的块
+  if (n > 0)
+    readahead(ip, off, n);
+
   // 逐块读取数据
   for (tot = 0; tot < n; tot += m, off += m, dst += m)
   {
     // 获取当前块地址
-    uint addr = bmap(ip, off / BSIZE);
+    uint addr = bmap(ip, off / BSIZE, 0);
+    // 计算本次读取的字节数
+    m = min(n - tot, BSIZE - off % BSIZE);
     if (addr == 0)
-      break;
+    {
+      // 未分配的块（哈希目录中的空洞）读出全零
+      if (either_copyout(user_dst, dst, (char *)zeroes, m) == -1)
+      {
+        tot = -1;
+        break;
+      }
+      continue;
+    }
     // 读取块数据
     bp = bread(ip->dev, addr);
-    // 计算本次读取的字节数
-    m = min(n - tot, BSIZE - off % BSIZE);
     // 复制数据到目标地址
     if (either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1)
     {
@@ -580,14 +1258,17 @@ int writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   if (off > ip->size || off + n < off)
     return -1;
   // 检查是否超过最大文件大小
-  if (off + n > MAXFILE * BSIZE)
+  if (off + n > (ip->flags & DI_EXTENTS ? EXTMAXFILE : MAXFILE) * BSIZE)
     return -1;
 
+  // 文件内容即将改变，丢弃缓存的程序页面
+  textinval(ip->dev, ip->inum);
+
   // 逐块写入数据
   for (tot = 0; tot < n; tot += m, off += m, src += m)
   {
     // 获取或分配当前块地址
-    uint addr = bmap(ip, off / BSIZE);
+    uint addr = bmap(ip, off / BSIZE, 1);
     if (addr == 0)
       break;
     // 读取块数据
@@ -624,6 +1305,183 @@ int namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+/** 哈希目录
+ *  带DI_HASHDIR标志的目录按fs.h中描述的格式存放：名字散列到
+ *  NDIRHASH个块之一，满了再依次探测后面最多DIRPROBE-1块，
+ *  所以查找、插入和删除都只涉及常数个块。块在第一次有名字
+ *  放进去时才分配。块0的头部记录目录中的总项数，isdirempty()
+ *  只需要读这一项。
+ */
+
+/// @brief 读取哈希目录dp的第b块。
+/// 未分配的块在alloc为0时返回0，否则分配一个全零的块。
+static struct buf *
+hdirblock(struct inode *dp, uint b, int alloc)
+{
+  uint addr;
+
+  if ((addr = bmap(dp, b, alloc)) == 0)
+    return 0;
+  return bread(dp->dev, addr);
+}
+
+/// @brief "."和".."固定在块0的第1、2项，返回其序号；其他名字返回0。
+static int
+hdirdot(char *name)
+{
+  if (namecmp(name, ".") == 0)
+    return 1;
+  if (namecmp(name, "..") == 0)
+    return 2;
+  return 0;
+}
+
+/// @brief 在哈希目录dp中查找name。
+/// @return 返回inode号并设置*poff，找不到返回0
+static uint
+hdirlookup(struct inode *dp, char *name, uint *poff)
+{
+  struct buf *bp;
+  struct dirent *de;
+  uint b, i, k, inum, overflow;
+
+  if ((i = hdirdot(name)) != 0)
+  {
+    if ((bp = hdirblock(dp, 0, 0)) == 0)
+      return 0;
+    inum = ((struct dirent *)bp->data)[i].inum;
+    brelse(bp);
+    *poff = i * sizeof(struct dirent);
+    return inum;
+  }
+
+  b = dirhash(name) % NDIRHASH;
+  for (k = 0; k < DIRPROBE; k++, b = (b + 1) % NDIRHASH)
+  {
+    // 空洞里没有名字，也不会有名字越过它
+    if ((bp = hdirblock(dp, b, 0)) == 0)
+      return 0;
+    de = (struct dirent *)bp->data;
+    for (i = (b == 0 ? 3 : 1); i < DPB; i++)
+    {
+      if (de[i].inum != 0 && namecmp(name, de[i].name) == 0)
+      {
+        inum = de[i].inum;
+        brelse(bp);
+        *poff = b * BSIZE + i * sizeof(struct dirent);
+        return inum;
+      }
+    }
+    overflow = ((struct dirhdr *)bp->data)->overflow;
+    brelse(bp);
+    if (!overflow)
+      break;
+  }
+  return 0;
+}
+
+/// @brief 块0头部的总项数加上delta。bp是已读出的块0，或为0。
+static void
+hdirtotal(struct inode *dp, struct buf *bp, int delta)
+{
+  struct buf *b0 = bp ? bp : hdirblock(dp, 0, 1);
+
+  if (b0 == 0)
+    panic("hdirtotal");
+  ((struct dirhdr *)b0->data)->total += delta;
+  if (bp == 0)
+  {
+    log_write(b0);
+    brelse(b0);
+  }
+}
+
+/// @brief 在哈希目录dp中加入(name, inum)，调用者已确认name不存在。
+/// @return 返回目录项的字节偏移量；探测范围内的块都满了时返回EDIRFULL，
+/// 磁盘满时返回-1
+static int
+hdirlink(struct inode *dp, char *name, uint inum)
+{
+  struct buf *bp = 0;
+  struct dirhdr *h;
+  struct dirent *de;
+  uint b, i, k;
+  int off;
+
+  if ((i = hdirdot(name)) != 0)
+  {
+    b = 0;
+    if ((bp = hdirblock(dp, 0, 1)) == 0)
+      return -1;
+  }
+  else
+  {
+    b = dirhash(name) % NDIRHASH;
+    for (k = 0; k < DIRPROBE; k++, b = (b + 1) % NDIRHASH)
+    {
+      if ((bp = hdirblock(dp, b, 1)) == 0)
+        return -1;
+      de = (struct dirent *)bp->data;
+      for (i = (b == 0 ? 3 : 1); i < DPB && de[i].inum != 0; i++)
+        ;
+      if (i < DPB)
+        break;
+      // 这一块满了，记下有名字越过了它
+      h = (struct dirhdr *)bp->data;
+      if (!h->overflow)
+      {
+        h->overflow = 1;
+        log_write(bp);
+      }
+      brelse(bp);
+      bp = 0;
+    }
+    if (bp == 0)
+      return EDIRFULL;
+  }
+
+  de = (struct dirent *)bp->data;
+  strncpy(de[i].name, name, DIRSIZ);
+  de[i].inum = inum;
+  ((struct dirhdr *)bp->data)->count++;
+  hdirtotal(dp, b == 0 ? bp : 0, 1);
+  log_write(bp);
+  brelse(bp);
+  off = b * BSIZE + i * sizeof(struct dirent);
+  // bmap()可能分配了新块
+  iupdate(dp);
+  return off;
+}
+
+/// @brief 删除哈希目录dp中偏移量off处的目录项。
+static void
+hdirunlink(struct inode *dp, uint off)
+{
+  struct buf *bp;
+  uint b = off / BSIZE;
+
+  if ((bp = hdirblock(dp, b, 0)) == 0)
+    panic("hdirunlink");
+  memset(bp->data + off % BSIZE, 0, sizeof(struct dirent));
+  ((struct dirhdr *)bp->data)->count--;
+  hdirtotal(dp, b == 0 ? bp : 0, -1);
+  log_write(bp);
+  brelse(bp);
+}
+
+/// @brief 返回哈希目录dp中的目录项数，包括"."和".."。
+int hdircount(struct inode *dp)
+{
+  struct buf *bp;
+  int n;
+
+  if ((bp = hdirblock(dp, 0, 0)) == 0)
+    return 0;
+  n = ((struct dirhdr *)bp->data)->total;
+  brelse(bp);
+  return n;
+}
+
 /// @brief 在目录中查找目录项。
 /// 如果找到，将*poff设置为目录项的字节偏移量。
 struct inode *
@@ -636,6 +1494,27 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   if (dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  // 先查目录项缓存，命中时不必扫描目录；inum为0表示确定不存在
+  if (dcache_lookup(dp->dev, dp->inum, name, &inum, &off))
+  {
+    if (inum == 0)
+      return 0;
+    if (poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+
+  if (dp->flags & DI_HASHDIR)
+  {
+    inum = hdirlookup(dp, name, &off);
+    dcache_enter(dp->dev, dp->inum, name, inum, inum ? off : 0);
+    if (inum == 0)
+      return 0;
+    if (poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+
   // 遍历目录中的所有目录项
   for (off = 0; off < dp->size; off += sizeof(de))
   {
@@ -652,15 +1531,19 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       if (poff)
         *poff = off;
       inum = de.inum;
+      dcache_enter(dp->dev, dp->inum, name, inum, off);
       return iget(dp->dev, inum);
     }
   }
 
+  // 记住这个名字不存在
+  dcache_enter(dp->dev, dp->inum, name, 0, 0);
   return 0;
 }
 
 /// @brief 向目录dp写入新的目录项(name, inum)。
-/// 成功时返回0，失败时返回-1（例如磁盘块不足）。
+/// 成功时返回0，失败时返回-1（例如磁盘块不足）；
+/// 哈希目录中name的探测块都满了时返回EDIRFULL。
 int dirlink(struct inode *dp, char *name, uint inum)
 {
   int off;
@@ -674,6 +1557,14 @@ int dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
+  if (dp->flags & DI_HASHDIR)
+  {
+    if ((off = hdirlink(dp, name, inum)) < 0)
+      return off;
+    dcache_enter(dp->dev, dp->inum, name, inum, off);
+    return 0;
+  }
+
   // 查找空的目录项
   for (off = 0; off < dp->size; off += sizeof(de))
   {
@@ -689,10 +1580,32 @@ int dirlink(struct inode *dp, char *name, uint inum)
   // 写入目录项
   if (writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     return -1;
+  // 替换目录项缓存中的否定项
+  dcache_enter(dp->dev, dp->inum, name, inum, off);
 
   return 0;
 }
 
+/// @brief 删除目录dp中偏移量off处名为name的目录项。
+/// 调用者持有dp->lock，off由dirlookup()得到。
+void dirunlink(struct inode *dp, char *name, uint off)
+{
+  struct dirent de;
+
+  if (dp->flags & DI_HASHDIR)
+  {
+    hdirunlink(dp, off);
+  }
+  else
+  {
+    memset(&de, 0, sizeof(de));
+    if (writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+      panic("unlink: writei");
+  }
+  // 现在是一个否定项
+  dcache_enter(dp->dev, dp->inum, name, 0, 0);
+}
+
 // 路径（Path）相关操作
 
 /// @brief 从路径中复制下一个路径元素到name。
@@ -20,24 +20,55 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint features;     // FS_* flags
 };
 
 #define FSMAGIC 0x10203040
 
-#define NDIRECT 12
+#define FS_EXTENTS 0x1  // new inodes map their blocks with extents
+
+// addrs[] holds NDIRECT direct blocks, then a singly, a doubly
+// and a triply indirect block.
+#define NDIRECT 10
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define NTINDIRECT (NDINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT + NTINDIRECT)
 
 // On-disk inode structure
 struct dinode {
-  short type;           // File type
+  uchar type;           // File type
+  uchar flags;          // DI_* flags
   short major;          // Major device number (T_DEVICE only)
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+3];   // Data block addresses
+};
+
+#define DI_EXTENTS 0x1  // addrs[] holds an extent tree
+#define DI_HASHDIR 0x2  // a directory in the hashed format below
+
+// An extent-mapped inode keeps an exthdr and up to NIEXTENT
+// extents, sorted by lblk, in the space of addrs[].  At depth 0
+// they map file blocks directly.  At depth 1 each one instead
+// names a leaf block (pblk) whose file blocks start at lblk,
+// and the leaf holds an exthdr and up to NLEXTENT extents.
+struct extent {
+  uint lblk;            // first file block
+  uint pblk;            // first disk block
+  uint len;             // number of blocks; 0 in an index entry
+};
+
+struct exthdr {
+  ushort n;             // extents in use
+  ushort depth;         // 0 or 1
 };
 
+#define NIEXTENT 4
+#define NLEXTENT ((BSIZE - sizeof(struct exthdr)) / sizeof(struct extent))
+#define EXTMAXFILE (1 << 21)  // keeps byte offsets within a uint
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
@@ -58,3 +89,43 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// A hashed directory is NDIRHASH blocks long, but blocks are only
+// allocated once a name goes into them; until then they read as
+// zeros.  A name lives in block dirhash(name) % NDIRHASH or, if
+// that block is full, in one of the next DIRPROBE-1 blocks.
+// The table does not grow, so a name whose home block and probe
+// blocks are all full (DIRPROBE*(DPB-1) entries, fewer for block
+// 0) cannot be added even though other blocks have room; link()
+// and the calls that create files then return EDIRFULL.
+// The first dirent of each block is a dirhdr, whose inum of 0
+// makes it look like a free entry to programs that read the
+// directory as a sequence of dirents.  "." and ".." are always
+// the second and third dirents of block 0.
+struct dirhdr {
+  ushort inum;          // always 0
+  ushort count;         // entries in use in this block
+  ushort overflow;      // a name that hashes here went to a later block
+  ushort pad;
+  uint total;           // block 0 only: entries in the directory
+  uint pad2;
+};
+
+#define NDIRHASH 64
+#define DIRPROBE 2
+#define EDIRFULL (-2)  // no room for a name in its probe blocks
+#define DPB (BSIZE / sizeof(struct dirent))  // dirents per block
+
+// FNV-1a hash of a directory entry name.
+static inline uint
+dirhash(const char *name)
+{
+  uint h = 2166136261U;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (unsigned char)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
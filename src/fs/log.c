@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "proc.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -19,95 +20,311 @@
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the log is committed.
 //
-// The log is a physical re-do log containing disk blocks.
-// The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
-//   block A
-//   block B
-//   block C
-//   ...
-// Log appends are synchronous.
-
-// Contents of the header block, used for both the on-disk header block
-// and to keep track in memory of logged block# before commit.
-struct logheader {
+// begin_op() reserves room for MAXOPBLOCKS blocks, the most
+// any FS system call writes.  A caller that knows it needs
+// fewer, such as filewrite(), calls begin_opn() with its own
+// estimate instead, so that more calls fit in a transaction
+// at once.  Each block that log_write() adds to the
+// transaction uses up one block of the caller's reservation,
+// and end_op() gives back whatever is left.
+//
+// Group commit: end_op() does not commit as soon as no FS
+// system calls are active.  The transaction keeps absorbing
+// later system calls until one of these happens:
+//   the transaction is close to full, in which case the last
+//     end_op() commits it;
+//   it is LOGFLUSHTICKS ticks old, in which case the
+//     log_flusher() kernel thread commits it;
+//   somebody calls log_force(), e.g. from fsync().
+// So a system call that does not need its changes to be
+// durable returns without waiting for the disk, and a crash
+// loses at most the last LOGFLUSHTICKS ticks of changes, but
+// never leaves the file system inconsistent.
+//
+// The log is a physical re-do log containing disk blocks,
+// used as a circular journal.  The on-disk log format:
+//   log super block: magic, sequence number and position of
+//     the oldest transaction that may not be checkpointed
+//   circular area of sb.nlog-1 blocks, holding transactions:
+//     descriptor block: magic, sequence number, block #s
+//       for block A, B, C, ...
+//     block A
+//     block B
+//     block C
+//     ...
+//     descriptor block of the next transaction
+//     ...
+// A commit writes the transaction's blocks as one batch and
+// then its descriptor, which is the true commit point.
+//
+// Committed blocks are not copied to their home locations
+// right away; commit marks them dirty in the buffer cache,
+// whose write-back (see bio.c) writes each of them home once,
+// however many transactions changed it, in block order.  A
+// checkpoint writes back whatever is still dirty and then
+// advances the log super block past the transactions in the
+// log.  It happens when the circular area is too full for
+// another transaction, or from log_flusher() when the log has
+// been idle for LOGCKPTTICKS ticks.
+//
+// Write-back may copy a block home while a later, uncommitted
+// transaction has changed it.  That is safe: the block belongs
+// to a committed transaction that the log super block still
+// names, so recovery would overwrite it with the committed
+// contents, and a checkpoint only runs between transactions.
+//
+// Recovery replays every transaction from the one the log
+// super block names, in order, until it finds a descriptor
+// with the wrong sequence number.  So that a logged block left
+// over from an earlier pass through the circular area can never
+// pass for a descriptor, a block whose first word is LOGMAGIC is
+// logged with that word zeroed and LOGESCAPE set on its number
+// in the descriptor, and replay puts the word back.
+
+#define LOGBATCH 32          // most blocks written to the disk at once
+#define LOGMAGIC 0x6c6f6731  // in the log super block and descriptors
+#define LOGESCAPE 0x80000000 // in a descriptor: block began with LOGMAGIC
+
+// most blocks a descriptor can name.
+#define LOGDESCMAX ((BSIZE - 3*sizeof(uint)) / sizeof(uint))
+
+// The first block of the log.
+struct logsuper {
+  uint magic;
+  uint seq;    // sequence number of the transaction at tail
+  uint tail;   // where replay starts, in the circular area
+};
+
+// The first block of each transaction in the log.
+struct logdesc {
+  uint magic;
+  uint seq;
+  uint n;
+  uint block[LOGDESCMAX];
+};
+
+// A set of block numbers, in the order they were added, with
+// an open-addressing hash so that membership costs O(1).
+// Block 0 is never logged, so 0 marks an empty hash slot.
+struct blockset {
   int n;
-  int block[LOGSIZE];
+  int max;
+  uint *block;  // the members
+  uint *slot;   // where block[i] lives in hash[]
+  uint *hash;
+  uint mask;    // hash[] has mask+1 slots
 };
 
 struct log {
   struct spinlock lock;
-  int start;
-  int size;
+  int start;       // log super block; the circular area follows
+  int size;        // blocks in the circular area
+  int maxtxn;      // most blocks in one transaction
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int committing;  // in commit() or checkpoint(), please wait.
+  int forcing;     // log_force() is waiting; commit at once.
+  uint since;      // ticks when the open transaction began.
+  uint idle;       // ticks when the last commit finished.
+  uint64 seq;      // number of the open transaction.
+  uint64 done;     // number of the last committed transaction.
+  int reserved;    // blocks reserved by active FS sys calls.
   int dev;
-  struct logheader lh;
+  struct blockset lh; // blocks in the open transaction.
+
+  // Only the committer uses the rest, while log.committing
+  // keeps everybody else out.
+  uint escaped[(LOGDESCMAX+31)/32]; // blocks write_log() escaped
+  int head;        // where the next transaction goes
+  int tail;        // oldest transaction not checkpointed
+  int used;        // blocks from tail to head
 };
 struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static void checkpoint(uint);
+static void log_flusher(void);
+
+// Allocate a set for up to max blocks: one page holds the
+// block[] and slot[] arrays, and another the hash, which is
+// at most half full.
+static void
+bsinit(struct blockset *s, int max)
+{
+  char *mem, *hash;
+
+  if (max > PGSIZE / (2*sizeof(uint)))
+    panic("bsinit: too big");
+  if ((mem = kalloc()) == 0 || (hash = kalloc()) == 0)
+    panic("bsinit: kalloc");
+  memset(hash, 0, PGSIZE);
+  s->n = 0;
+  s->max = max;
+  s->block = (uint *) mem;
+  s->slot = (uint *) (mem + PGSIZE/2);
+  s->hash = (uint *) hash;
+  for (s->mask = 1; s->mask < 2*max; s->mask <<= 1)
+    ;
+  s->mask -= 1;
+}
+
+// Add blockno to s.  Returns 1 if it is new, 0 if it
+// was already there, -1 if it is new but s is full.
+static int
+bsadd(struct blockset *s, uint blockno)
+{
+  uint h;
+
+  for (h = (blockno * 2654435761U) & s->mask; s->hash[h]; h = (h + 1) & s->mask) {
+    if (s->hash[h] == blockno)
+      return 0;
+  }
+  if (s->n >= s->max)
+    return -1;
+  s->hash[h] = blockno;
+  s->slot[s->n] = h;
+  s->block[s->n++] = blockno;
+  return 1;
+}
+
+// Empty s, clearing only the hash slots it used.
+static void
+bsclear(struct blockset *s)
+{
+  int i;
+
+  for (i = 0; i < s->n; i++)
+    s->hash[s->slot[i]] = 0;
+  s->n = 0;
+}
 
 void
 initlog(int dev, struct superblock *sb)
 {
-  if (sizeof(struct logheader) >= BSIZE)
-    panic("initlog: too big logheader");
+  if (sizeof(struct logdesc) > BSIZE || sizeof(struct logsuper) > BSIZE)
+    panic("initlog: too big logdesc");
 
   initlock(&log.lock, "log");
   log.start = sb->logstart;
-  log.size = sb->nlog;
+  log.size = sb->nlog - 1;
   log.dev = dev;
+  if (log.size > MAXLOGSIZE)
+    panic("initlog: log too big");
+  // leave room for two transactions between checkpoints.
+  log.maxtxn = (log.size - 2) / 2;
+  if (log.maxtxn > LOGDESCMAX)
+    log.maxtxn = LOGDESCMAX;
+  // log_write() pins every block of the open transaction, and
+  // the cache can shrink to NBUF buffers; leave room for the
+  // buffers the ops themselves are using.
+  if (log.maxtxn > NBUF - MAXOPBLOCKS)
+    log.maxtxn = NBUF - MAXOPBLOCKS;
+  // unlink() of a large file reserves MAXOPBLOCKS plus what
+  // itrunc() may log: the inode and every bitmap block.
+  if (log.maxtxn < MAXOPBLOCKS + 1 + (sb->size + BPB - 1) / BPB)
+    panic("initlog: log too small");
+  bsinit(&log.lh, log.maxtxn);
   recover_from_log();
+
+  if(kthread_create(log_flusher, "logflush") < 0)
+    panic("initlog: flusher");
 }
 
-// Copy committed blocks from log to their home location
+// Disk block number of block i of the circular area.
+static int
+logblock(int i)
+{
+  return log.start + 1 + i % log.size;
+}
+
+// Write the log super block, recording that replay should
+// start at the transaction at tail, numbered seq.
 static void
-install_trans(int recovering)
-{
-  int tail;
-
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
-  }
+write_super(int tail, uint seq)
+{
+  struct buf *buf = bnew(log.dev, log.start);
+  struct logsuper *ls = (struct logsuper *) (buf->data);
+
+  ls->magic = LOGMAGIC;
+  ls->seq = seq;
+  ls->tail = tail;
+  bwrite(buf);
+  brelse(buf);
 }
 
-// Read the log header from disk into the in-memory log header
+// Copy the n blocks of the committed transaction whose
+// descriptor is at pos in the log to their home locations,
+// a batch of up to LOGBATCH blocks at a time.
 static void
-read_head(void)
+replay_trans(int pos, int n)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
+  struct buf *dbuf[LOGBATCH];
+  uint lblock[LOGBATCH];
+  int tail, i, m;
+
+  for (tail = 0; tail < n; tail += m) {
+    m = n - tail;
+    if (m > LOGBATCH)
+      m = LOGBATCH;
+    for (i = 0; i < m; i++)
+      lblock[i] = logblock(pos + 1 + tail + i);
+    breadahead(log.dev, lblock, m);
+    for (i = 0; i < m; i++) {
+      uint b = log.lh.block[tail+i];
+      struct buf *lbuf = bread(log.dev, lblock[i]); // read log block
+      dbuf[i] = bnew(log.dev, b & ~LOGESCAPE); // dst
+      memmove(dbuf[i]->data, lbuf->data, BSIZE);  // copy block to dst
+      if (b & LOGESCAPE)
+        *(uint *)dbuf[i]->data = LOGMAGIC;
+      brelse(lbuf);
+    }
+    bwritev(dbuf, m);  // write dst to disk
+    for (i = 0; i < m; i++)
+      brelse(dbuf[i]);
+  }
+}
+
+// Read the descriptor at pos into log.lh.block[], bypassing
+// the hash, which recovery does not need.  Returns 0 if it
+// describes the transaction numbered seq, -1 if not, which
+// marks the end of the committed transactions.
+static int
+read_desc(int pos, uint seq)
+{
+  struct buf *buf = bread(log.dev, logblock(pos));
+  struct logdesc *d = (struct logdesc *) (buf->data);
   int i;
-  log.lh.n = lh->n;
+
+  if (d->magic != LOGMAGIC || d->seq != seq || d->n > log.maxtxn) {
+    brelse(buf);
+    return -1;
+  }
+  log.lh.n = d->n;
   for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+    log.lh.block[i] = d->block[i];
   }
   brelse(buf);
+  return 0;
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Write the descriptor of the open transaction at log.head.
+// This is the true point at which the transaction commits.
 static void
-write_head(void)
+write_desc(void)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
+  struct buf *buf = bnew(log.dev, logblock(log.head));
+  struct logdesc *d = (struct logdesc *) (buf->data);
   int i;
-  hb->n = log.lh.n;
+
+  d->magic = LOGMAGIC;
+  d->seq = log.seq;
+  d->n = log.lh.n;
   for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+    d->block[i] = log.lh.block[i];
+    if (log.escaped[i/32] & (1u << (i%32)))
+      d->block[i] |= LOGESCAPE;
   }
   bwrite(buf);
   brelse(buf);
@@ -116,90 +333,260 @@ write_head(void)
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(1); // if committed, copy from log to disk
+  struct buf *buf = bread(log.dev, log.start);
+  struct logsuper *ls = (struct logsuper *) (buf->data);
+  int pos, used;
+
+  // a fresh file system has a zeroed log.
+  if (ls->magic == LOGMAGIC && ls->tail < log.size) {
+    pos = ls->tail;
+    log.seq = ls->seq;
+  } else {
+    pos = 0;
+    log.seq = 1;
+  }
+  brelse(buf);
+
+  // replay committed transactions in order.
+  for (used = 0; read_desc(pos, log.seq) == 0; ) {
+    if (used + 1 + log.lh.n > log.size)
+      break;
+    replay_trans(pos, log.lh.n);
+    used += 1 + log.lh.n;
+    pos = (pos + 1 + log.lh.n) % log.size;
+    log.seq++;
+  }
+
   log.lh.n = 0;
-  write_head(); // clear the log
+  log.head = log.tail = pos;
+  log.used = 0;
+  log.done = log.seq - 1;
+  write_super(pos, log.seq); // everything is home now
 }
 
-// called at the start of each FS system call.
+// called at the start of each FS system call that writes
+// at most n blocks.
 void
-begin_op(void)
+begin_opn(int n)
 {
+  struct proc *p = myproc();
+
+  if(n < 1 || n > log.maxtxn)
+    panic("begin_opn");
   acquire(&log.lock);
   while(1){
     if(log.committing){
-      sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+      sleep(&log.reserved, &log.lock);
+    } else if(log.lh.n + log.reserved + n > log.maxtxn){
       // this op might exhaust log space; wait for commit.
-      sleep(&log, &log.lock);
+      sleep(&log.reserved, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += n;
+      p->logres = n;
+      // waiters are woken one at a time; pass it on if
+      // another op might fit.
+      if(log.lh.n + log.reserved < log.maxtxn)
+        wakeone(&log.reserved);
       release(&log.lock);
       break;
     }
   }
 }
 
+// called at the start of each FS system call.
+void
+begin_op(void)
+{
+  begin_opn(MAXOPBLOCKS);
+}
+
+// Commit the open transaction.  Caller holds log.lock, and
+// no FS system calls may be active.  Releases log.lock while
+// writing to the disk.
+static void
+commit_locked(void)
+{
+  int n = log.lh.n;
+
+  log.committing = 1;
+  log.forcing = 0;
+  // call commit w/o holding locks, since not allowed
+  // to sleep with locks.
+  release(&log.lock);
+  commit();
+  acquire(&log.lock);
+  log.committing = 0;
+  if (n > 0)
+    log.done = log.seq++;
+  log.idle = ticks;
+  wakeup(&log);
+  wakeone(&log.reserved);
+}
+
+// Write committed blocks home.  Caller holds log.lock, and
+// no FS system calls may be active and no transaction open.
+static void
+checkpoint_locked(void)
+{
+  log.committing = 1;
+  release(&log.lock);
+  checkpoint(log.seq);
+  acquire(&log.lock);
+  log.committing = 0;
+  wakeone(&log.reserved);
+}
+
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// commits if this was the last outstanding operation and
+// the transaction is close to full, or log_force() is waiting.
 void
 end_op(void)
 {
-  int do_commit = 0;
+  struct proc *p = myproc();
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= p->logres;
+  p->logres = 0;
   if(log.committing)
     panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
+  if(log.outstanding == 0 && log.lh.n > 0 &&
+     (log.forcing || log.lh.n + MAXOPBLOCKS > log.maxtxn)){
+    commit_locked();
   } else {
     // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
+    // and this op's unused reservation is free again.
+    wakeone(&log.reserved);
   }
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+// Make every FS system call that has already ended durable,
+// by committing the open transaction if it has any changes.
+void
+log_force(void)
+{
+  uint64 want;
+
+  acquire(&log.lock);
+  want = log.seq;
+  if(!log.committing && log.lh.n == 0)
+    want = log.done;  // nothing since the last commit
+  while(log.done < want){
+    if(!log.committing && log.outstanding == 0){
+      commit_locked();
+    } else {
+      // the last end_op() will commit for us.
+      log.forcing = 1;
+      sleep(&log, &log.lock);
+    }
   }
+  release(&log.lock);
 }
 
-// Copy modified blocks from cache to log.
+// Kernel thread that commits the open transaction once it
+// is LOGFLUSHTICKS ticks old, so that changes reach the disk
+// even if nobody calls fsync(), and checkpoints the log once
+// it has been idle for LOGCKPTTICKS ticks, so that committed
+// blocks do not stay pinned in the cache for ever.
+static void
+log_flusher(void)
+{
+  acquire(&log.lock);
+  for(;;){
+    if(log.committing || log.outstanding > 0){
+      sleep(&ticks, &log.lock);
+    } else if(log.lh.n > 0 && ticks - log.since >= LOGFLUSHTICKS){
+      commit_locked();
+    } else if(log.lh.n == 0 && log.used > 0 &&
+              ticks - log.idle >= LOGCKPTTICKS){
+      checkpoint_locked();
+    } else {
+      sleep(&ticks, &log.lock);
+    }
+  }
+}
+
+// Copy modified blocks from cache to the log, after the
+// descriptor's slot at log.head.  The log blocks are written
+// in batches of up to LOGBATCH and waited for once per batch.
 static void
 write_log(void)
 {
-  int tail;
+  struct buf *to[LOGBATCH];
+  int tail, i, n;
+
+  memset(log.escaped, 0, sizeof(log.escaped));
+  for (tail = 0; tail < log.lh.n; tail += n) {
+    n = log.lh.n - tail;
+    if (n > LOGBATCH)
+      n = LOGBATCH;
+    for (i = 0; i < n; i++) {
+      to[i] = bnew(log.dev, logblock(log.head+1+tail+i)); // log block
+      struct buf *from = bread(log.dev, log.lh.block[tail+i]); // cache block
+      memmove(to[i]->data, from->data, BSIZE);
+      if (*(uint *)to[i]->data == LOGMAGIC) {
+        // must not look like a descriptor; see the top.
+        *(uint *)to[i]->data = 0;
+        log.escaped[(tail+i)/32] |= 1u << ((tail+i)%32);
+      }
+      brelse(from);
+    }
+    bwritev(to, n);  // write the log
+    for (i = 0; i < n; i++)
+      brelse(to[i]);
+  }
+}
+
+// Hand the committed transaction's blocks over to write-back.
+// A dirty buffer stays in the cache until it is written home,
+// so the pin log_write() took is no longer needed.
+static void
+ckpt_add(void)
+{
+  int i;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  for (i = 0; i < log.lh.n; i++) {
+    struct buf *b = bread(log.dev, log.lh.block[i]);
+    bdwrite(b);
+    bunpin(b);
+    brelse(b);
   }
 }
 
+// Write every committed block that is still dirty to its
+// home location, then record in the log super block that the
+// log is empty and the next transaction will be numbered next.
+static void
+checkpoint(uint next)
+{
+  bflush(log.dev, 0);
+
+  log.tail = log.head;
+  log.used = 0;
+  write_super(log.tail, next);
+}
+
 static void
 commit()
 {
+  uint next = log.seq;  // number of the transaction after this one
+
   if (log.lh.n > 0) {
+    if (log.used + 1 + log.lh.n > log.size)
+      panic("commit: log full");
     write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    write_desc();    // Write descriptor to disk -- the real commit
+    ckpt_add();      // Home writes are left to write-back
+    log.head = (log.head + 1 + log.lh.n) % log.size;
+    log.used += 1 + log.lh.n;
+    bsclear(&log.lh);
+    next++;
   }
+  // make sure the next transaction will fit.
+  if (log.size - log.used < 1 + log.maxtxn)
+    checkpoint(next);
 }
 
 // Caller has modified b->data and is done with the buffer.
@@ -214,23 +601,25 @@ commit()
 void
 log_write(struct buf *b)
 {
-  int i;
+  struct proc *p = myproc();
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
-    panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
-  for (i = 0; i < log.lh.n; i++) {
-    if (log.lh.block[i] == b->blockno)   // log absorption
-      break;
-  }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n) {  // Add new block to log?
+  if (log.lh.n == 0)
+    log.since = ticks;
+  switch (bsadd(&log.lh, b->blockno)) {
+  case 1:   // Add new block to log
     bpin(b);
-    log.lh.n++;
+    if (p->logres > 0) {
+      p->logres--;
+      log.reserved--;
+    }
+    break;
+  case -1:
+    panic("too big a transaction");
   }
+  // otherwise log absorption
   release(&log.lock);
 }
-
@@ -76,18 +76,30 @@ pipeclose(struct pipe *pi, int writable)
 int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-  int i = 0;
+  int i = 0, ready;
   struct proc *pr = myproc();
 
+  // copyin() under pi->lock must not fault in a program page,
+  // which may sleep (see execfault()); fault the source in a
+  // page at a time with the lock released.
+  ready = uvmfaultpage(pr->pagetable, addr, n, 0);
   acquire(&pi->lock);
   while(i < n){
     if(pi->readopen == 0 || killed(pr)){
+      // we may have been woken to write; let another writer.
+      wakeone(&pi->nwrite);
       release(&pi->lock);
       return -1;
     }
     if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
-      wakeup(&pi->nread);
+      wakeone(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
+    } else if(i == ready){
+      release(&pi->lock);
+      ready = i + uvmfaultpage(pr->pagetable, addr + i, n - i, 0);
+      acquire(&pi->lock);
+      if(ready == i)
+        break;
     } else {
       char ch;
       if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
@@ -96,7 +108,11 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       i++;
     }
   }
-  wakeup(&pi->nread);
+  // one reader can take all the data, and passes on what it
+  // leaves; likewise for room left for other writers.
+  wakeone(&pi->nread);
+  if(pi->nwrite != pi->nread + PIPESIZE)
+    wakeone(&pi->nwrite);
   release(&pi->lock);
 
   return i;
@@ -105,26 +121,38 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
 int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
+  int i, ready;
   struct proc *pr = myproc();
   char ch;
 
+  // as in pipewrite(), fault the destination in a page at a
+  // time with pi->lock released.
+  ready = uvmfaultpage(pr->pagetable, addr, n, 1);
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
     if(killed(pr)){
+      // we may have been woken to read; let another reader.
+      wakeone(&pi->nread);
       release(&pi->lock);
       return -1;
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
   for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
+    if(i == ready && i > 0){
+      release(&pi->lock);
+      ready = i + uvmfaultpage(pr->pagetable, addr + i, n - i, 1);
+      acquire(&pi->lock);
+    }
+    if(pi->nread == pi->nwrite || i == ready)
       break;
     ch = pi->data[pi->nread++ % PIPESIZE];
     if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
       break;
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  wakeone(&pi->nwrite);  //DOC: piperead-wakeup
+  if(pi->nread != pi->nwrite)
+    wakeone(&pi->nread);  // data left for another reader
   release(&pi->lock);
   return i;
 }
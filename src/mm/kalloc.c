@@ -1,14 +1,34 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
 // and pipe buffers. Allocates whole 4096-byte pages.
+//
+// Each CPU keeps a private free list in its struct cpu, so
+// kalloc() and kfree() normally touch only that CPU's lock.
+// The private lists refill from and spill to the shared kmem
+// pool KBATCH pages at a time; a CPU whose list and the shared
+// pool are both empty steals half of another CPU's list before
+// reporting out-of-memory.
+//
+// Every allocated page also carries a reference count, so that
+// copy-on-write fork can share a page between processes; kfree()
+// only returns the page to a free list when the last reference
+// is dropped.
+//
+// When every list is empty, kalloc() asks caches that hold
+// pages only as an optimization (see kreclaim()) to free some
+// before giving up.
 
 #include "types.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "proc.h"
 #include "defs.h"
 
+#define KBATCH     32          // pages moved per refill/spill
+#define KLOCALMAX  (2*KBATCH)  // spill when a CPU list grows past this
+
 void freerange(void *pa_start, void *pa_end);
 
 extern char end[]; // first address after kernel.
@@ -18,15 +38,27 @@ struct run {
   struct run *next;
 };
 
+// reference count of each physical page, indexed by PA2REF(pa).
+// updated with atomic instructions so that sharing and freeing a
+// page never needs a lock.
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+static int pgref[PA2REF(PHYSTOP)];
+
+// the shared pool.
 struct {
   struct spinlock lock;
   struct run *freelist;
+  int nfree;
 } kmem;
 
 void
 kinit()
 {
+  struct cpu *c;
+
   initlock(&kmem.lock, "kmem");
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    initlock(&c->kmemlock, "kmem_cpu");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,31 +67,168 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    pgref[PA2REF(p)] = 1;
     kfree(p);
+  }
+}
+
+// Move up to KBATCH pages from the shared pool to c's list.
+// Caller holds c->kmemlock.
+static void
+krefill(struct cpu *c)
+{
+  struct run *r;
+  int n;
+
+  acquire(&kmem.lock);
+  for(n = 0; n < KBATCH && (r = kmem.freelist) != 0; n++){
+    kmem.freelist = r->next;
+    r->next = c->freelist;
+    c->freelist = r;
+  }
+  kmem.nfree -= n;
+  release(&kmem.lock);
+  c->nfree += n;
+}
+
+// Move KBATCH pages from c's list back to the shared pool.
+// Caller holds c->kmemlock.
+static void
+kspill(struct cpu *c)
+{
+  struct run *head, *tail;
+  int n;
+
+  head = tail = c->freelist;
+  for(n = 1; n < KBATCH && tail->next; n++)
+    tail = tail->next;
+  c->freelist = tail->next;
+  c->nfree -= n;
+
+  acquire(&kmem.lock);
+  tail->next = kmem.freelist;
+  kmem.freelist = head;
+  kmem.nfree += n;
+  release(&kmem.lock);
 }
 
-// Free the page of physical memory pointed at by pa,
-// which normally should have been returned by a
+// Take half of some other CPU's free list.
+// Keeps one page for the caller and gives the rest to c.
+// Caller must not hold any kmem lock, since it takes
+// the victim's lock.
+static struct run*
+ksteal(struct cpu *c)
+{
+  struct cpu *v;
+  struct run *r, *tail;
+  int i, n;
+
+  for(v = cpus; v < &cpus[NCPU]; v++){
+    if(v == c || v->nfree == 0)  // unlocked peek; rechecked below
+      continue;
+    acquire(&v->kmemlock);
+    if((r = v->freelist) == 0){
+      release(&v->kmemlock);
+      continue;
+    }
+    n = (v->nfree + 1) / 2;
+    tail = r;
+    for(i = 1; i < n; i++)
+      tail = tail->next;
+    v->freelist = tail->next;
+    v->nfree -= n;
+    release(&v->kmemlock);
+
+    tail->next = 0;
+    if(n > 1){
+      acquire(&c->kmemlock);
+      tail->next = c->freelist;
+      c->freelist = r->next;
+      c->nfree += n - 1;
+      release(&c->kmemlock);
+    }
+    return r;
+  }
+  return 0;
+}
+
+// Drop a reference to the page of physical memory pointed at
+// by pa, which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// The page is freed when its last reference goes away.
 void
 kfree(void *pa)
 {
   struct run *r;
+  struct cpu *c;
+  int ref;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  ref = __sync_sub_and_fetch(&pgref[PA2REF(pa)], 1);
+  if(ref > 0)
+    return;
+  if(ref < 0)
+    panic("kfree: ref");
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();  // stay on this CPU while using its list.
+  c = mycpu();
+  acquire(&c->kmemlock);
+  r->next = c->freelist;
+  c->freelist = r;
+  c->nfree++;
+  if(c->nfree > KLOCALMAX)
+    kspill(c);
+  release(&c->kmemlock);
+  pop_off();
+}
+
+// Take a page from this CPU's list, the shared pool, or
+// another CPU, in that order.
+static struct run*
+kget(void)
+{
+  struct run *r;
+  struct cpu *c;
+
+  push_off();
+  c = mycpu();
+  acquire(&c->kmemlock);
+  if(c->freelist == 0)
+    krefill(c);
+  r = c->freelist;
+  if(r){
+    c->freelist = r->next;
+    c->nfree--;
+  }
+  release(&c->kmemlock);
+
+  if(r == 0)
+    r = ksteal(c);
+  pop_off();
+  return r;
+}
+
+// Ask caches that keep pages only to save work later to
+// give back what they can.  Returns the number of pages freed.
+// Called without any kmem lock held.
+static int
+kreclaim(void)
+{
+  int n;
+
+  n = textreclaim();
+  n += bshrink();
+  n += ishrink();
+  return n;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -70,13 +239,30 @@ kalloc(void)
 {
   struct run *r;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  if((r = kget()) == 0 && kreclaim() > 0)
+    r = kget();
 
-  if(r)
+  if(r){
     memset((char*)r, 5, PGSIZE); // fill with junk
+    pgref[PA2REF(r)] = 1;
+  }
   return (void*)r;
 }
+
+// Add a reference to an allocated page, e.g. when
+// fork shares it copy-on-write with a child.
+void
+kaddref(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kaddref");
+  if(__sync_fetch_and_add(&pgref[PA2REF(pa)], 1) < 1)
+    panic("kaddref: free page");
+}
+
+// Return the number of references to an allocated page.
+int
+krefcnt(void *pa)
+{
+  return __sync_fetch_and_add(&pgref[PA2REF(pa)], 0);
+}
@@ -0,0 +1,193 @@
+// Cache of read-only program pages.
+//
+// When several processes run the same binary, execfault() would
+// otherwise read a private copy of every text page for each of
+// them.  Instead, pages of non-writable segments are kept here,
+// keyed by (dev, inum, file offset, bytes read), and mapped
+// read-only into every process that touches them; kaddref()
+// accounts for each mapping, and the cache itself holds one more
+// reference.
+//
+// writei() and itrunc() call textinval() so that a rewritten
+// binary is read afresh by the next exec; processes that are
+// still running keep the pages they already have mapped.
+// Pages that no process maps any more are given back by
+// textreclaim() when kalloc() runs out of memory.
+//
+// The hash is keyed by (dev, inum) only, so that invalidating
+// a file looks at a single bucket.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define NTBUCKET 31
+
+struct tpage {
+  uint dev;
+  uint inum;
+  uint off;             // offset of the page in the file
+  uint n;               // bytes read from the file; the rest is zero
+  char *pa;             // the page, or 0 if this entry is free
+  struct tpage *next;   // hash chain, or free list
+};
+
+struct {
+  struct spinlock lock;
+  struct tpage page[NTEXTPAGE];
+  struct tpage *bucket[NTBUCKET];
+  struct tpage *free;
+} tcache;
+
+// number of page faults served from the cache.
+uint64 texthits;
+
+static struct tpage**
+tbucket(uint dev, uint inum)
+{
+  // the multiplier must be coprime to NTBUCKET, or dev drops out.
+  return &tcache.bucket[(dev * 37 + inum) % NTBUCKET];
+}
+
+void
+textinit(void)
+{
+  struct tpage *t;
+
+  initlock(&tcache.lock, "textcache");
+  for(t = tcache.page; t < &tcache.page[NTEXTPAGE]; t++){
+    t->next = tcache.free;
+    tcache.free = t;
+  }
+}
+
+// Unlink t, which is in the chain at *pp, drop the cache's
+// reference to its page, and put it on the free list.
+// Caller holds tcache.lock.
+static void
+tdrop(struct tpage **pp, struct tpage *t)
+{
+  *pp = t->next;
+  kfree(t->pa);
+  t->pa = 0;
+  t->next = tcache.free;
+  tcache.free = t;
+}
+
+// Look up the page for n bytes at off in the given file.
+// Returns the page with a reference added for the caller's
+// mapping, or 0 if it is not cached.
+char*
+textget(uint dev, uint inum, uint off, uint n)
+{
+  struct tpage *t;
+  char *pa = 0;
+
+  acquire(&tcache.lock);
+  for(t = *tbucket(dev, inum); t; t = t->next){
+    if(t->dev == dev && t->inum == inum && t->off == off && t->n == n){
+      pa = t->pa;
+      kaddref(pa);
+      __sync_fetch_and_add(&texthits, 1);
+      break;
+    }
+  }
+  release(&tcache.lock);
+  return pa;
+}
+
+// Offer pa, just read from the file, to the cache.
+// Returns the page the caller should map: pa, or a page that
+// another process cached first, in which case pa is freed.
+// The caller's reference is passed to the returned page.
+// The caller must hold the inode's lock, so that the page
+// cannot go stale before it is in the cache.
+char*
+textput(uint dev, uint inum, uint off, uint n, char *pa)
+{
+  struct tpage *t, **pp;
+
+  acquire(&tcache.lock);
+  for(t = *tbucket(dev, inum); t; t = t->next){
+    if(t->dev == dev && t->inum == inum && t->off == off && t->n == n){
+      kaddref(t->pa);
+      release(&tcache.lock);
+      kfree(pa);
+      return t->pa;
+    }
+  }
+
+  if(tcache.free == 0){
+    // recycle an entry whose page no process maps.
+    for(int b = 0; b < NTBUCKET && tcache.free == 0; b++){
+      for(pp = &tcache.bucket[b]; (t = *pp) != 0; pp = &t->next){
+        if(krefcnt(t->pa) == 1){
+          tdrop(pp, t);
+          break;
+        }
+      }
+    }
+  }
+
+  if((t = tcache.free) != 0){
+    tcache.free = t->next;
+    t->dev = dev;
+    t->inum = inum;
+    t->off = off;
+    t->n = n;
+    t->pa = pa;
+    kaddref(pa);
+    pp = tbucket(dev, inum);
+    t->next = *pp;
+    *pp = t;
+  }
+  release(&tcache.lock);
+  return pa;
+}
+
+// Forget all cached pages of a file whose contents
+// are changing.
+void
+textinval(uint dev, uint inum)
+{
+  struct tpage *t, **pp;
+
+  pp = tbucket(dev, inum);
+  if(*pp == 0)  // unlocked peek; most writes are to non-programs
+    return;
+
+  acquire(&tcache.lock);
+  while((t = *pp) != 0){
+    if(t->dev == dev && t->inum == inum)
+      tdrop(pp, t);
+    else
+      pp = &t->next;
+  }
+  release(&tcache.lock);
+}
+
+// Free cached pages that no process maps.
+// Returns the number of pages freed.
+int
+textreclaim(void)
+{
+  struct tpage *t, **pp;
+  int b, n = 0;
+
+  acquire(&tcache.lock);
+  for(b = 0; b < NTBUCKET; b++){
+    pp = &tcache.bucket[b];
+    while((t = *pp) != 0){
+      if(krefcnt(t->pa) == 1){
+        tdrop(pp, t);
+        n++;
+      } else {
+        pp = &t->next;
+      }
+    }
+  }
+  release(&tcache.lock);
+  return n;
+}
@@ -3,6 +3,8 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 
@@ -30,6 +32,9 @@ kvmmake(void)
   // virtio mmio磁盘接口
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT：空闲的CPU停止自己的定时器，并通过 MSIP 唤醒别的CPU
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
@@ -292,14 +297,12 @@ free_physical_page_from_pte(pte_t pte)
 static inline void
 validate_page_mapping(pte_t pte)
 {
-  if (!is_pte_valid(pte))
-    panic("uvmunmap: page not mapped");
   if (PTE_FLAGS(pte) == PTE_V)
     panic("uvmunmap: not a leaf page");
 }
 
 // 从va开始移除npages个映射。va必须是
-// 页面对齐的。映射必须存在。
+// 页面对齐的。懒分配留下的未映射页面会被跳过。
 // 可选择释放物理内存
 void uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
@@ -312,8 +315,8 @@ void uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
   for (current_va = va; current_va < va + npages * PGSIZE; current_va += PGSIZE)
   {
     pte = walk(pagetable, current_va, 0);
-    if (pte == 0)
-      panic("uvmunmap: walk failed");
+    if (pte == 0 || !is_pte_valid(*pte))
+      continue; // 从未被访问过的懒分配页面
 
     validate_page_mapping(*pte);
 
@@ -459,18 +462,6 @@ void uvmfree(pagetable_t pagetable, uint64 sz)
   freewalk(pagetable);
 }
 
-// 复制物理页面内容
-static inline int
-copy_physical_page(uint64 src_pa, char **dest_mem)
-{
-  *dest_mem = kalloc();
-  if (*dest_mem == 0)
-    return -1; // 内存分配失败
-
-  memmove(*dest_mem, (char *)src_pa, PGSIZE);
-  return 0;
-}
-
 // 清理部分复制的页面（错误处理）
 static inline void
 cleanup_partial_copy(pagetable_t new_table, uint64 copied_size)
@@ -479,8 +470,10 @@ cleanup_partial_copy(pagetable_t new_table, uint64 copied_size)
   uvmunmap(new_table, 0, npages, 1);
 }
 
-// 给定父进程的页表，复制其内存到子进程的页表
-// 复制页表和物理内存
+// 给定父进程的页表，将其内存以写时复制（COW）方式共享给子进程
+// 只复制页表，不复制物理内存：可写页面在父子进程中都被改为
+// 只读并打上PTE_COW标记，物理页面引用计数加一，
+// 等到任一方写入时再由uvmcow()复制
 // 成功返回0，失败返回-1
 // 失败时释放任何已分配的页面
 int uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
@@ -488,28 +481,23 @@ int uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   pte_t *pte;
   uint64 pa, current_va;
   uint flags;
-  char *mem;
 
   for (current_va = 0; current_va < sz; current_va += PGSIZE)
   {
     pte = walk(old, current_va, 0);
-    if (pte == 0)
-      panic("uvmcopy: pte should exist");
+    if (pte == 0 || !is_pte_valid(*pte))
+      continue; // 尚未分配的懒分配页面，子进程访问时再分配
 
-    if (!is_pte_valid(*pte))
-      panic("uvmcopy: page not present");
+    // 可写页面改为只读的写时复制页面，父进程一侧同样修改
+    if (*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
 
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
 
-    if (copy_physical_page(pa, &mem) != 0)
+    if (mappages(new, current_va, PGSIZE, pa, flags) != 0)
       goto err;
-
-    if (mappages(new, current_va, PGSIZE, (uint64)mem, flags) != 0)
-    {
-      kfree(mem);
-      goto err;
-    }
+    kaddref((void *)pa);
   }
   return 0;
 
@@ -518,6 +506,138 @@ err:
   return -1;
 }
 
+// 处理对写时复制页面va的写入：
+// 如果物理页面仍被其他页表共享，则复制一份私有副本；
+// 如果只剩当前页表引用，则直接恢复写权限
+// 成功返回0，va不是写时复制页面或内存不足返回-1
+int uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if (va >= MAXVA)
+    return -1;
+
+  pte = walk(pagetable, PGROUNDDOWN(va), 0);
+  if (pte == 0 || !is_user_accessible_page(*pte) || (*pte & PTE_COW) == 0)
+    return -1;
+
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+
+  if (krefcnt((void *)pa) == 1)
+  {
+    // 其他进程已经放弃了这个页面，无需复制
+    *pte = create_mapping_pte(pa, flags);
+    return 0;
+  }
+
+  if ((mem = kalloc()) == 0)
+    return -1;
+  memmove(mem, (char *)pa, PGSIZE);
+  *pte = create_mapping_pte((uint64)mem, flags);
+  kfree((void *)pa); // 释放对共享页面的引用
+  return 0;
+}
+
+// 为进程大小sz以内、尚未映射的用户页面va分配一个清零的
+// 物理页面（sbrk的懒分配）
+// 成功返回0，va越界、已映射或内存不足返回-1
+static int
+uvmlazy(pagetable_t pagetable, uint64 va, uint64 sz)
+{
+  pte_t *pte;
+  char *mem;
+
+  if (va >= sz)
+    return -1;
+  va = PGROUNDDOWN(va);
+
+  pte = walk(pagetable, va, 0);
+  if (pte != 0 && is_pte_valid(*pte))
+    return -1; // 已映射，例如栈保护页
+
+  if ((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if (mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_R | PTE_W | PTE_U) != 0)
+  {
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// 处理用户地址va上的缺页，write表示是否为写访问：
+//  - 写时复制页面上的写入：交给uvmcow()复制页面
+//  - 当前进程大小以内但尚未映射的页面：懒分配一个清零页面
+// 由usertrap()以及copyin()/copyout()等内核访问用户内存的函数调用
+// 成功返回0，访问非法或内存不足返回-1
+int vmfault(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  int r;
+
+  if (va >= MAXVA)
+    return -1;
+
+  pte = walk(pagetable, PGROUNDDOWN(va), 0);
+  if (pte != 0 && is_pte_valid(*pte))
+  {
+    if (write && (*pte & PTE_COW))
+      return uvmcow(pagetable, va);
+    return -1; // 真正的访问违例
+  }
+
+  // 只有当前进程的地址空间才知道哪些页面是懒分配的
+  if (p == 0 || p->pagetable != pagetable)
+    return -1;
+
+  // exec() 留待首次访问时才从文件读入的程序页面
+  r = execfault(p, va, write);
+  if (r <= 0)
+    return r;
+  return uvmlazy(pagetable, va, p->sz);
+}
+
+// 把用户地址[va, va+len)的页面事先准备好：懒分配、写时复制
+// （write时），以及 exec() 留待首次访问的程序页面。调用者在
+// 持有自旋锁或 inode 锁之前调用，之后的 copyin()/copyout() 就
+// 不会进入 execfault() 去睡眠或获取可执行文件的 inode 锁。
+// 只应准备将要复制的字节，以免无谓地分配懒分配页面或打破写时复制。
+// 返回从va起已准备好的字节数，遇到不可访问的页面时小于len
+uint64 uvmfaultin(pagetable_t pagetable, uint64 va, uint64 len, int write)
+{
+  uint64 a;
+  pte_t *pte;
+
+  for (a = PGROUNDDOWN(va); a < va + len && a >= PGROUNDDOWN(va); a += PGSIZE)
+  {
+    if (a >= MAXVA)
+      break;
+    pte = walk(pagetable, a, 0);
+    if (pte != 0 && is_pte_valid(*pte) && !(write && (*pte & PTE_COW)))
+      continue;
+    if (vmfault(pagetable, a, write) != 0)
+      break;
+  }
+  if (a <= va)
+    return 0;
+  return a - va < len ? a - va : len;
+}
+
+// 同uvmfaultin()，但只准备va所在的一页。供持有自旋锁逐字节
+// 复制的调用者（管道、控制台）在锁外一次准备一页。
+uint64 uvmfaultpage(pagetable_t pagetable, uint64 va, uint64 len, int write)
+{
+  uint64 n = PGSIZE - (va % PGSIZE);
+
+  return uvmfaultin(pagetable, va, len < n ? len : n, write);
+}
+
 // 清除PTE的用户访问位
 static inline void
 clear_user_access_bit(pte_t *pte)
@@ -549,17 +669,26 @@ bytes_to_copy_in_page(uint64 va, uint64 remaining_len)
 
 // 从内核复制到用户
 // 将len字节从src复制到给定页表中的虚拟地址dstva
+// 目标页面必须可写；懒分配页面会先被分配，写时复制页面会先被复制
 // 成功返回0，错误返回-1
 int copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 bytes_to_copy, page_va, page_pa;
+  pte_t *pte;
 
   while (len > 0)
   {
     page_va = PGROUNDDOWN(dstva);
-    page_pa = walkaddr(pagetable, page_va);
-    if (page_pa == 0)
-      return -1; // 页面映射不存在或不可访问
+    if (page_va >= MAXVA)
+      return -1;
+    pte = walk(pagetable, page_va, 0);
+    if ((pte == 0 || !is_pte_valid(*pte) || (*pte & PTE_COW)) &&
+        vmfault(pagetable, page_va, 1) != 0)
+      return -1; // 懒分配或写时复制失败
+    pte = walk(pagetable, page_va, 0);
+    if (!is_user_accessible_page(*pte) || (*pte & PTE_W) == 0)
+      return -1; // 只读页面
+    page_pa = PTE2PA(*pte);
 
     bytes_to_copy = bytes_to_copy_in_page(dstva, len);
 
@@ -585,7 +714,12 @@ int copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
     page_va = PGROUNDDOWN(srcva);
     page_pa = walkaddr(pagetable, page_va);
     if (page_pa == 0)
-      return -1; // 页面映射不存在或不可访问
+    {
+      // 可能是尚未分配的懒分配页面
+      if (vmfault(pagetable, page_va, 0) != 0)
+        return -1; // 页面映射不存在或不可访问
+      page_pa = walkaddr(pagetable, page_va);
+    }
 
     bytes_to_copy = bytes_to_copy_in_page(srcva, len);
 
@@ -613,7 +747,11 @@ int copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
     if (pa0 == 0)
-      return -1;
+    {
+      if (vmfault(pagetable, va0, 0) != 0)
+        return -1;
+      pa0 = walkaddr(pagetable, va0);
+    }
     n = PGSIZE - (srcva - va0);
     if (n > max)
       n = max;
@@ -1,13 +1,29 @@
 #define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
+#define NPRIO         3  // scheduling priority levels; level i's quantum is 2^i ticks
+#define BOOSTTICKS   30  // every process returns to its base level this often
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // initial size of the in-memory i-node table
+#define ICACHEFRAC   64  // i-node table may grow to 1/ICACHEFRAC of RAM
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define MAXSEG        4  // max demand-paged program segments per process
+#define EXECDEMAND    1  // exec() reads program pages on first touch
+#define NTEXTPAGE   256  // size of shared program text page cache
+#define NDCACHE     256  // size of directory name lookup cache
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       2000  // size of file system in blocks
+#define LOGSIZE      126  // blocks in the on-disk log made by mkfs by default
+#define MAXLOGSIZE   512  // most blocks in an on-disk log the kernel accepts
+#define LOGFLUSHTICKS 3  // commit the log once a transaction is this old
+#define LOGCKPTTICKS 30  // checkpoint the log once it has been idle this long
+#define NBUF         (MAXLOGSIZE/2+MAXOPBLOCKS)  // minimum size of disk block cache;
+                                             // holds a whole transaction, pinned
+#define BCACHEFRAC   8  // disk block cache may grow to 1/BCACHEFRAC of RAM
+#define BDIRTYTICKS 30  // write back a dirty block once it is this old
+#define BDIRTYFRAC   4  // or once 1/BDIRTYFRAC of the cache is dirty
+#define RAMIN         4  // initial sequential read-ahead window, in blocks
+#define RAMAX        32  // largest read-ahead window, in blocks
+#define FSSIZE      65536  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
@@ -6,9 +6,15 @@
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 
 static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
 
+// number of program pages read in by execfault().
+uint64 execfaults;
+
 int flags2perm(int flags)
 {
     int perm = 0;
@@ -26,8 +32,10 @@ exec(char *path, char **argv)
   int i, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *execip = 0, *oldexecip;
   struct proghdr ph;
+  struct progseg seg[MAXSEG];
+  int nseg = 0;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
@@ -61,6 +69,19 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
+    if(EXECDEMAND && nseg < MAXSEG){
+      // Only remember where the segment lives in the file;
+      // execfault() reads each page when it is first touched.
+      seg[nseg].va = ph.vaddr;
+      seg[nseg].memsz = ph.memsz;
+      seg[nseg].off = ph.off;
+      seg[nseg].filesz = ph.filesz;
+      seg[nseg].perm = flags2perm(ph.flags);
+      nseg++;
+      if(ph.vaddr + ph.memsz > sz)
+        sz = ph.vaddr + ph.memsz;
+      continue;
+    }
     uint64 sz1;
     if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
       goto bad;
@@ -68,7 +89,13 @@ exec(char *path, char **argv)
     if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
-  iunlockput(ip);
+  if(nseg > 0){
+    // keep a reference for execfault().
+    execip = ip;
+    iunlock(ip);
+  } else {
+    iunlockput(ip);
+  }
   end_op();
   ip = 0;
 
@@ -122,11 +149,20 @@ exec(char *path, char **argv)
     
   // Commit to the user image.
   oldpagetable = p->pagetable;
+  oldexecip = p->execip;
   p->pagetable = pagetable;
   p->sz = sz;
+  p->execip = execip;
+  p->nseg = nseg;
+  memmove(p->seg, seg, sizeof(seg));
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  if(oldexecip){
+    begin_op();
+    iput(oldexecip);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -137,6 +173,11 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(execip){
+    begin_op();
+    iput(execip);
+    end_op();
+  }
   return -1;
 }
 
@@ -164,3 +205,82 @@ loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz
   
   return 0;
 }
+
+// Read the page containing va from the executable, for a
+// process whose exec() left segment pages to be loaded on
+// first touch, and map it.  write is set for store faults.
+// Pages of read-only segments come from, and are added to,
+// the shared text page cache (textcache.c).
+// Returns 0 on success, -1 if the access is illegal or the
+// page cannot be read, and 1 if va is not in such a segment.
+int
+execfault(struct proc *p, uint64 va, int write)
+{
+  struct progseg *s;
+  struct inode *ip = p->execip;
+  uint64 i, n = 0;
+  char *mem;
+  int locked, shared, spinning;
+
+  va = PGROUNDDOWN(va);
+  for(s = p->seg; s < &p->seg[p->nseg]; s++)
+    if(va >= s->va && va < s->va + s->memsz)
+      break;
+  if(s == &p->seg[p->nseg])
+    return 1;
+  if(write && (s->perm & PTE_W) == 0)
+    return -1;
+
+  i = va - s->va;
+  if(i < s->filesz){
+    n = s->filesz - i;
+    if(n > PGSIZE)
+      n = PGSIZE;
+  }
+  shared = n > 0 && (s->perm & PTE_W) == 0;
+
+  if(shared && (mem = textget(ip->dev, ip->inum, s->off + i, n)) != 0)
+    goto map;
+
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+
+  if(n > 0){
+    // readi() may sleep, which copyin() and copyout() under a
+    // spinlock (pipes, the console, wait()) must not do; those
+    // callers fault the range in beforehand with uvmfaultin().
+    push_off();
+    spinning = mycpu()->noff > 1;
+    pop_off();
+    if(spinning){
+      kfree(mem);
+      return -1;
+    }
+    // the fault may come from copyout() in readi() or writei()
+    // on the executable itself, which already holds the lock.
+    locked = holdingsleep(&ip->lock);
+    if(!locked)
+      ilock(ip);
+    if(readi(ip, 0, (uint64)mem, s->off + i, n) != n){
+      if(!locked)
+        iunlock(ip);
+      kfree(mem);
+      return -1;
+    }
+    // still holding the lock, so no writei() can have
+    // made the page stale.
+    if(shared)
+      mem = textput(ip->dev, ip->inum, s->off + i, n, mem);
+    if(!locked)
+      iunlock(ip);
+    __sync_fetch_and_add(&execfaults, 1);
+  }
+
+map:
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, PTE_R | PTE_U | s->perm) != 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
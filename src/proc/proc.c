@@ -17,6 +17,7 @@ struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void waitqinit(void);
 
 extern char trampoline[]; // trampoline.S
 
@@ -51,8 +52,12 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  waitqinit();
+  for(int i = 0; i < NCPU; i++)
+    initlock(&cpus[i].rqlock, "runq");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
+      p->cpu = 0;
       p->state = UNUSED;
       p->kstack = KSTACK((int) (p - proc));
   }
@@ -124,6 +129,9 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
+  p->prio = p->nice = p->slice = 0;
+  p->affinity = (1 << NCPU) - 1;
+  p->boostgen = ticks / BOOSTTICKS;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -162,6 +170,9 @@ freeproc(struct proc *p)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
   p->sz = 0;
+  p->execip = 0;
+  p->nseg = 0;
+  p->kfn = 0;
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
@@ -249,26 +260,37 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
 
 // Grow or shrink user memory by n bytes.
+// Growing only moves p->sz; the pages are allocated
+// and zeroed on first touch by vmfault().
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
 {
+  int i;
   uint64 sz;
   struct proc *p = myproc();
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+    if(sz + n > TRAPFRAME)
       return -1;
-    }
+    sz += n;
   } else if(n < 0){
     sz = uvmdealloc(p->pagetable, sz, sz + n);
+    // memory given back must not fault in from the
+    // executable again if the heap later regrows.
+    for(i = 0; i < p->nseg; i++){
+      if(p->seg[i].va >= PGROUNDUP(sz))
+        p->seg[i].memsz = 0;
+      else if(p->seg[i].va + p->seg[i].memsz > PGROUNDUP(sz))
+        p->seg[i].memsz = PGROUNDUP(sz) - p->seg[i].va;
+    }
   }
   p->sz = sz;
   return 0;
@@ -308,6 +330,13 @@ fork(void)
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
 
+  // the child faults in not-yet-loaded program pages
+  // from the same executable.
+  if(p->execip)
+    np->execip = idup(p->execip);
+  np->nseg = p->nseg;
+  memmove(np->seg, p->seg, sizeof(p->seg));
+
   safestrcpy(np->name, p->name, sizeof(p->name));
 
   pid = np->pid;
@@ -319,7 +348,10 @@ fork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  np->cpu = cpuid();  // idle CPUs steal it if this one is busy
+  np->nice = np->prio = p->nice;
+  np->affinity = p->affinity;
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
@@ -360,10 +392,19 @@ exit(int status)
     }
   }
 
+  // each iput() may truncate an unlinked inode, which can log
+  // as many blocks as a whole op; give each its own transaction.
   begin_op();
   iput(p->cwd);
   end_op();
+  if(p->execip){
+    begin_op();
+    iput(p->execip);
+    end_op();
+  }
   p->cwd = 0;
+  p->execip = 0;
+  p->nseg = 0;
 
   acquire(&wait_lock);
 
@@ -394,6 +435,11 @@ wait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
+  // the status is copied out under wait_lock and pp->lock,
+  // so fault the page in now, while we may still sleep.
+  if(addr != 0)
+    uvmfaultin(p->pagetable, addr, sizeof(int), 1);
+
   acquire(&wait_lock);
 
   for(;;){
@@ -455,26 +501,97 @@ forkret(void)
   usertrapret();
 }
 
+// A kernel thread's first scheduling by scheduler()
+// will swtch to kthreadstart.
+static void
+kthreadstart(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  p->kfn();
+  panic("kthread returned");
+}
+
+// Create a kernel thread that runs fn in its own process,
+// entirely in the kernel; fn must never return.
+// Returns the new thread's pid, or -1 on error.
+int
+kthread_create(void (*fn)(void), char *name)
+{
+  struct proc *p;
+  int pid;
+
+  if((p = allocproc()) == 0)
+    return -1;
+  p->kfn = fn;
+  p->context.ra = (uint64)kthreadstart;
+  safestrcpy(p->name, name, sizeof(p->name));
+  pid = p->pid;
+  setrunnable(p);
+  release(&p->lock);
+  return pid;
+}
+
+// Wait queues.  A process sleeping on chan is kept on the
+// queue of the bucket that chan hashes to, oldest first, so
+// that wakeup() looks only at processes that may be sleeping
+// on chan instead of at every process.  The bucket's lock
+// protects the queue and the chan of the processes on it.
+// Lock order: the lock passed to sleep(), then the bucket's
+// lock, then p->lock.
+#define NWAITQ 61
+
+struct {
+  struct spinlock lock;
+  struct proc *head;
+  struct proc *tail;
+} waitq[NWAITQ];
+
+static int
+wqhash(void *chan)
+{
+  return ((uint64)chan >> 3) % NWAITQ;
+}
+
+static void
+waitqinit(void)
+{
+  for(int i = 0; i < NWAITQ; i++)
+    initlock(&waitq[i].lock, "waitq");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  int h = wqhash(chan);
   
-  // Must acquire p->lock in order to
-  // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
-  // so it's okay to release lk.
-
+  // Must be on chan's wait queue and have
+  // changed p->state before releasing lk.
+  // wakeup() takes the queue's lock before
+  // p->lock, so once we hold the queue's lock
+  // we can be guaranteed that we won't miss
+  // any wakeup, so it's okay to release lk.
+
+  acquire(&waitq[h].lock);
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->wqnext = 0;
+  if(waitq[h].tail)
+    waitq[h].tail->wqnext = p;
+  else
+    waitq[h].head = p;
+  waitq[h].tail = p;
+  release(&waitq[h].lock);
 
   sched();
 
@@ -486,22 +603,56 @@ sleep(void *chan, struct spinlock *lk)
   acquire(lk);
 }
 
+// Wake up the processes sleeping on chan: all of them,
+// or only the one that has slept longest.
+static void
+wake(void *chan, int all)
+{
+  int h = wqhash(chan);
+  struct proc *p, *prev, *next;
+
+  acquire(&waitq[h].lock);
+  prev = 0;
+  for(p = waitq[h].head; p; p = next){
+    next = p->wqnext;
+    if(p->chan != chan){
+      prev = p;
+      continue;
+    }
+    if(prev)
+      prev->wqnext = next;
+    else
+      waitq[h].head = next;
+    if(waitq[h].tail == p)
+      waitq[h].tail = prev;
+    acquire(&p->lock);
+    if(p->state != SLEEPING)
+      panic("wakeup");
+    setrunnable(p);
+    release(&p->lock);
+    if(!all)
+      break;
+  }
+  release(&waitq[h].lock);
+}
+
 // Wake up all processes sleeping on chan.
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  wake(chan, 1);
+}
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-    }
-  }
+// Wake up the process that has slept longest on chan, for
+// producer/consumer paths where one waiter can use what was
+// produced.  A waiter that is woken but leaves something for
+// the others must pass it on with another wakeone().
+// Must be called without any p->lock.
+void
+wakeone(void *chan)
+{
+  wake(chan, 0);
 }
 
 // Kill the process with the given pid.
@@ -511,16 +662,19 @@ int
 kill(int pid)
 {
   struct proc *p;
+  void *chan;
 
   for(p = proc; p < &proc[NPROC]; p++){
     acquire(&p->lock);
     if(p->pid == pid){
       p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
+      chan = p->state == SLEEPING ? p->chan : 0;
       release(&p->lock);
+      // Wake process from sleep().  wakeup() needs the wait
+      // queue's lock before p->lock, and wakes the other
+      // sleepers on chan too, which must check again anyway.
+      if(chan)
+        wakeup(chan);
       return 0;
     }
     release(&p->lock);
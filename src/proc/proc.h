@@ -24,6 +24,19 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+
+  // kalloc.c's per-CPU page cache.
+  struct spinlock kmemlock;   // Protects freelist and nfree (see ksteal()).
+  struct run *freelist;       // Free pages owned by this CPU.
+  int nfree;                  // Number of pages on freelist.
+
+  // scheduler.c's run queues of RUNNABLE processes, one per
+  // priority level.
+  struct spinlock rqlock;     // Protects rqhead, rqtail and nrun.
+  struct proc *rqhead[NPRIO]; // Next process to run at each level, or null.
+  struct proc *rqtail[NPRIO];
+  int nrun;                   // Number of processes on the queues.
+  uint boostgen;              // Boost period the queues were last boosted in.
 };
 
 extern struct cpu cpus[NCPU];
@@ -81,6 +94,16 @@ struct trapframe {
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A program segment whose pages exec() leaves to be read
+// from the executable on first touch; see execfault().
+struct progseg {
+  uint64 va;      // page-aligned start address
+  uint64 memsz;   // size in memory
+  uint64 off;     // offset of the segment in the file
+  uint64 filesz;  // bytes backed by the file; the rest is zero
+  int perm;       // PTE_W and/or PTE_X
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -91,6 +114,21 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int cpu;                     // CPU whose run queue p goes on
+
+  // p->lock must be held when using these, and also the run
+  // queue's lock while p is RUNNABLE:
+  int prio;                    // Current priority level, 0 is highest
+  int nice;                    // Base level, set by setpriority()
+  int slice;                   // Ticks used of this level's quantum
+  uint boostgen;               // Boost period prio was last reset in
+  int affinity;                // Mask of CPUs p may run on
+
+  // the run queue's lock must be held when using this:
+  struct proc *rqnext;         // Next process on the same run queue
+
+  // the wait queue's lock must be held when using this:
+  struct proc *wqnext;         // Next process on the same wait queue
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
@@ -103,6 +141,11 @@ struct proc {
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct inode *execip;        // Executable backing seg[], or null
+  int nseg;                    // Number of demand-paged segments
+  struct progseg seg[MAXSEG];  // Demand-paged program segments
+  void (*kfn)(void);           // Body of a kernel thread, or null
+  int logres;                  // Log blocks still reserved by begin_opn()
   char name[16];               // Process name (debugging)
 };
 
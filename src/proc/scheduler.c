@@ -6,6 +6,401 @@
 #include "proc.h"
 #include "defs.h"
 
+// 每个CPU有自己的可运行进程队列（struct cpu 中的 rq*），
+// 由 setrunnable() 入队：fork() 和 kthread_create() 把新进程
+// 放到当前CPU，wakeup() 放到进程上次运行的CPU，yield() 放回
+// 本CPU队尾。调度器只从自己的队列取进程；自己的队列为空时，
+// 从排队进程最多的CPU偷一个。调度的开销因此只与可运行进程数
+// 有关，而与 NPROC 无关，空闲的CPU也不会去获取每个 p->lock。
+//
+// 调度策略是多级反馈队列（MLFQ）：每个CPU每个优先级一个队列，
+// 总是先运行级别最高（p->prio 最小）的进程。第 i 级的时间片是
+// 2^i 个时钟周期，用完时间片的进程降一级，所以CPU密集的进程
+// 沉到低级别；从睡眠中醒来的进程（多半在等I/O）升一级。每
+// BOOSTTICKS 个时钟周期所有进程回到自己的基准级别 p->nice，
+// 低级别的进程不会饿死。setpriority() 设置基准级别。
+//
+// p->affinity 是进程可以运行的CPU的位掩码，fork() 时继承。
+// 进程只进入允许的CPU的队列，也只会被允许的CPU偷走；
+// 被限制在一个CPU上的进程从不迁移。
+//
+// 没有进程可运行的CPU在 idle() 中执行 wfi 睡眠，除 CPU 0
+// （它负责推进 ticks）外还停掉自己的定时器，不再空转。
+// setrunnable() 把醒来的或新建的进程优先放到空闲的CPU，
+// 并通过CLINT的 MSIP 发核间中断叫醒它；schedtick() 发现
+// 本CPU有进程在排队而别的CPU空闲时，也叫醒一个来偷。
+//
+// 锁的顺序：先 p->lock，再队列的 rqlock。
+
+// 已进入调度器的CPU的位掩码
+static uint onlinecpus;
+
+// 正在 idle() 中睡眠或即将睡眠的CPU的位掩码
+static uint idlecpus;
+
+// mask 中编号最小的CPU
+static int
+lowestcpu(uint mask)
+{
+  int i;
+
+  for(i = 0; i < NCPU - 1; i++)
+    if(mask & (1 << i))
+      break;
+  return i;
+}
+
+// 当前的提升周期
+static uint
+boostepoch(void)
+{
+  return ticks / BOOSTTICKS;
+}
+
+// 把 p 放到 c 中 p->prio 级队列的队尾。调用者持有 c->rqlock。
+static void
+rqpush(struct cpu *c, struct proc *p)
+{
+  int pri = p->prio;
+
+  p->rqnext = 0;
+  if(c->rqtail[pri])
+    c->rqtail[pri]->rqnext = p;
+  else
+    c->rqhead[pri] = p;
+  c->rqtail[pri] = p;
+  c->nrun++;
+}
+
+// 把 p 从 c 的队列中取下。p 不在队列中则返回0。
+// 调用者持有 c->rqlock。
+static int
+rqremove(struct cpu *c, struct proc *p)
+{
+  struct proc *q, *prev = 0;
+  int pri = p->prio;
+
+  for(q = c->rqhead[pri]; q && q != p; q = q->rqnext)
+    prev = q;
+  if(q == 0)
+    return 0;
+  if(prev)
+    prev->rqnext = p->rqnext;
+  else
+    c->rqhead[pri] = p->rqnext;
+  if(c->rqtail[pri] == p)
+    c->rqtail[pri] = prev;
+  c->nrun--;
+  return 1;
+}
+
+// 从 c 的队列中取出级别最高、最早入队且允许在CPU self
+// 上运行的进程，没有则返回0。
+static struct proc*
+rqpop(struct cpu *c, struct cpu *self)
+{
+  struct proc *p = 0;
+  uint bit = 1 << (self - cpus);
+
+  if(c->nrun == 0)  // 不加锁先看一眼，空队列不产生锁竞争
+    return 0;
+  acquire(&c->rqlock);
+  for(int pri = 0; pri < NPRIO && p == 0; pri++){
+    for(p = c->rqhead[pri]; p && !(p->affinity & bit); p = p->rqnext)
+      ;
+    if(p)
+      rqremove(c, p);
+  }
+  release(&c->rqlock);
+  return p;
+}
+
+// 新的提升周期开始时，把 c 的队列中的进程都移回基准级别。
+// 正在运行或睡眠的进程在 schedtick() 或 setrunnable() 中
+// 自己回到基准级别。
+static void
+boost(struct cpu *c)
+{
+  struct proc *p, *next;
+  uint gen = boostepoch();
+
+  acquire(&c->rqlock);
+  c->boostgen = gen;
+  for(int pri = 1; pri < NPRIO; pri++){
+    p = c->rqhead[pri];
+    c->rqhead[pri] = c->rqtail[pri] = 0;
+    for(; p; p = next){
+      next = p->rqnext;
+      c->nrun--;
+      p->prio = p->nice;
+      p->slice = 0;
+      p->boostgen = gen;
+      rqpush(c, p);
+    }
+  }
+  release(&c->rqlock);
+}
+
+// 从其他CPU偷一个 self 可以运行的进程，先试排队进程最多的；
+// 它的队列里都是不允许在 self 上运行的进程时，再试下一个。
+static struct proc*
+steal(struct cpu *self)
+{
+  struct cpu *c, *victim;
+  struct proc *p;
+  uint tried = 1 << (self - cpus);
+
+  for(;;){
+    victim = 0;
+    for(c = cpus; c < &cpus[NCPU]; c++){
+      if(!(tried & (1 << (c - cpus))) && c->nrun > 0 &&
+         (victim == 0 || c->nrun > victim->nrun))
+        victim = c;
+    }
+    if(victim == 0)
+      return 0;
+    if((p = rqpop(victim, self)) != 0)
+      return p;
+    tried |= 1 << (victim - cpus);
+  }
+}
+
+// 把 p 放入它可以运行的CPU的队列：优先是 p->cpu，
+// 否则是允许的在线CPU中编号最小的。调用者持有 p->lock。
+static void
+rqenqueue(struct proc *p)
+{
+  struct cpu *c;
+  int i;
+
+  if(!(p->affinity & (1 << p->cpu))){
+    for(i = 0; i < NCPU; i++){
+      if(p->affinity & onlinecpus & (1 << i)){
+        p->cpu = i;
+        break;
+      }
+    }
+  }
+  i = p->cpu;
+  c = &cpus[i];
+  acquire(&c->rqlock);
+  rqpush(c, p);
+  release(&c->rqlock);
+
+  // 先入队再查 idlecpus，与 idle() 中的顺序相反，
+  // 目标CPU要么看到这个进程，要么在这里被叫醒。
+  __sync_synchronize();
+  if((idlecpus & (1 << i)) && i != cpuid())
+    ipi(i);
+}
+
+// 返回 c 的队列中的进程可以运行的空闲CPU的位掩码。
+static uint
+stealable(struct cpu *c)
+{
+  struct proc *q;
+  uint mask = 0;
+
+  acquire(&c->rqlock);
+  for(int pri = 0; pri < NPRIO; pri++)
+    for(q = c->rqhead[pri]; q; q = q->rqnext)
+      mask |= q->affinity & idlecpus;
+  release(&c->rqlock);
+  return mask;
+}
+
+// 将进程 p 标记为可运行并放入 p->cpu 的队列。
+// 调用者持有 p->lock。
+void
+setrunnable(struct proc *p)
+{
+  if(!holding(&p->lock))
+    panic("setrunnable");
+  if(p->boostgen != boostepoch()){
+    p->boostgen = boostepoch();
+    p->prio = p->nice;
+    p->slice = 0;
+  } else if(p->state == SLEEPING){
+    // 醒来的进程升一级，重新开始计时间片
+    if(p->prio > p->nice)
+      p->prio--;
+    p->slice = 0;
+  }
+  // 醒来的或新建的进程：原来的CPU不空闲时，改放到
+  // 允许的空闲CPU上。让出CPU的进程仍回本CPU。
+  if(p->state != RUNNING && !(idlecpus & (1 << p->cpu))){
+    uint mask = idlecpus & p->affinity;
+    if(mask)
+      p->cpu = lowestcpu(mask);
+  }
+  p->state = RUNNABLE;
+  rqenqueue(p);
+}
+
+// 时钟中断时由正在运行的进程调用，代替直接 yield()：
+// 用完本级时间片的进程降一级并让出CPU；本CPU上有更高
+// 级别的进程在排队时也让出CPU。
+void
+schedtick(void)
+{
+  struct proc *p = myproc();
+  struct cpu *c;
+  int preempt = 0;
+  uint idle;
+
+  acquire(&p->lock);
+  c = mycpu();  // 持有 p->lock，中断已关闭
+  if(p->boostgen != boostepoch()){
+    p->boostgen = boostepoch();
+    p->prio = p->nice;
+    p->slice = 0;
+  }
+  if(++p->slice >= (1 << p->prio)){
+    if(p->prio < NPRIO-1)
+      p->prio++;
+    p->slice = 0;
+    preempt = 1;
+  } else {
+    for(int pri = 0; pri < p->prio; pri++)
+      if(c->rqhead[pri])
+        preempt = 1;
+    // 不再允许在这个CPU上运行
+    if(!(p->affinity & (1 << (c - cpus))))
+      preempt = 1;
+  }
+  // 本CPU有进程在排队，而别的CPU睡着：叫醒一个能运行
+  // 排队进程的CPU来偷；排队的进程都绑在本CPU上时不叫
+  if(c->nrun > 0 && idlecpus != 0 && (idle = stealable(c)) != 0)
+    ipi(lowestcpu(idle));
+  release(&p->lock);
+  if(preempt)
+    yield();
+}
+
+// 找到进程 pid，返回时持有它的 p->lock；没有则返回0。
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED)
+      return p;
+    release(&p->lock);
+  }
+  return 0;
+}
+
+// 把进程 pid 的基准级别设为 prio（0 最高），
+// 并让它从这一级重新开始。成功返回0，否则返回-1。
+int
+setpriority(int pid, int prio)
+{
+  struct proc *p;
+  struct cpu *c;
+
+  if(prio < 0 || prio >= NPRIO)
+    return -1;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  if(p->state == RUNNABLE){
+    // 排队中的进程换到新级别的队列；调度器可能
+    // 刚把它取下，正等着 p->lock。
+    c = &cpus[p->cpu];
+    acquire(&c->rqlock);
+    int queued = rqremove(c, p);
+    p->nice = p->prio = prio;
+    p->slice = 0;
+    if(queued)
+      rqpush(c, p);
+    release(&c->rqlock);
+  } else {
+    p->nice = p->prio = prio;
+    p->slice = 0;
+  }
+  release(&p->lock);
+  return 0;
+}
+
+// 把进程 pid 可以运行的CPU设为 mask（第 i 位表示CPU i），
+// mask 中至少要有一个在线的CPU。成功返回0，否则返回-1。
+int
+setaffinity(int pid, int mask)
+{
+  struct proc *p;
+  struct cpu *c;
+  int queued, self;
+
+  mask &= (1 << NCPU) - 1;
+  if((mask & onlinecpus) == 0)
+    return -1;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  if(p->state == RUNNABLE){
+    // 排队中的进程可能要换到别的CPU的队列
+    c = &cpus[p->cpu];
+    acquire(&c->rqlock);
+    queued = rqremove(c, p);
+    p->affinity = mask;
+    release(&c->rqlock);
+    if(queued)
+      rqenqueue(p);
+  } else {
+    p->affinity = mask;
+  }
+  self = p == myproc();
+  release(&p->lock);
+
+  // 调用者不能再在当前CPU上运行时，马上换到允许的CPU
+  push_off();
+  if(self && !(mask & (1 << cpuid()))){
+    pop_off();
+    yield();
+  } else {
+    pop_off();
+  }
+  return 0;
+}
+
+// 返回进程 pid 可以运行的CPU的位掩码，没有该进程则返回-1。
+int
+getaffinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  mask = p->affinity;
+  release(&p->lock);
+  return mask;
+}
+
+// 没有进程可运行时让CPU c 睡在 wfi 中。先在 idlecpus 中
+// 登记再查一遍队列，rqenqueue() 则先入队再查 idlecpus，两边
+// 之间都有完整的内存屏障，所以不会漏掉入队的进程。关着中断
+// 执行 wfi，醒来后中断在调度器循环开头打开时才处理。
+// 返回睡眠前找到的进程，或0。
+static struct proc*
+idle(struct cpu *c)
+{
+  struct proc *p;
+  int id = c - cpus;
+
+  intr_off();
+  __sync_fetch_and_or(&idlecpus, 1 << id);
+  if((p = rqpop(c, c)) == 0 && (p = steal(c)) == 0){
+    // CPU 0 要推进 ticks，它的定时器不停
+    if(id != 0)
+      timerstop();
+    wfi();
+    if(id != 0)
+      timerstart();
+  }
+  __sync_fetch_and_and(&idlecpus, ~(1 << id));
+  return p;
+}
 
 // 每个CPU的进程调度器
 // 每个CPU在完成自身设置后调用scheduler()
@@ -20,26 +415,35 @@ scheduler(void)
   struct cpu *c = mycpu();
   
   c->proc = 0;
+  __sync_fetch_and_or(&onlinecpus, 1 << (c - cpus));
   for(;;){
     // 通过确保设备能够产生中断来避免死锁
     intr_on();
 
-    // 遍历进程表，寻找可运行的进程
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // 切换到选中的进程。进程有责任释放其锁
-        // 然后在跳回调度器之前重新获取锁
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);  // 上下文切换到进程
-
-        // 进程暂时运行完毕
-        // 它应该在返回之前改变了p->state
-        c->proc = 0;
-      }
-      release(&p->lock);
-    }
+    if(c->boostgen != boostepoch())
+      boost(c);
+
+    // 先取自己队列中的进程，没有就去偷，都没有就睡
+    if((p = rqpop(c, c)) == 0 && (p = steal(c)) == 0 &&
+       (p = idle(c)) == 0)
+      continue;
+
+    // p 已离开队列，别人不会再选中它；但它可能还在
+    // 另一个CPU上切换出来，p->lock 要等那边的调度器释放。
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: not runnable");
+    // 切换到选中的进程。进程有责任释放其锁
+    // 然后在跳回调度器之前重新获取锁
+    p->state = RUNNING;
+    p->cpu = c - cpus;
+    c->proc = p;
+    swtch(&c->context, &p->context);  // 上下文切换到进程
+
+    // 进程暂时运行完毕
+    // 它应该在返回之前改变了p->state
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
@@ -73,7 +477,7 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);     // 获取进程锁
-  p->state = RUNNABLE;   // 将进程状态设为可运行
+  setrunnable(p);        // 设为可运行，放回本CPU队尾
   sched();               // 调用sched()切换到调度器
   release(&p->lock);     // 释放进程锁
 }
\ No newline at end of file
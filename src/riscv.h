@@ -279,6 +279,14 @@ intr_off()
   w_sstatus(r_sstatus() & ~SSTATUS_SIE);
 }
 
+// wait for an interrupt; returns at once if one is pending,
+// even with device interrupts disabled.
+static inline void
+wfi()
+{
+  asm volatile("wfi" : : : "memory");
+}
+
 // are device interrupts enabled?
 static inline int
 intr_get()
@@ -343,6 +351,7 @@ typedef uint64 *pagetable_t; // 512 PTEs
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // user can access
+#define PTE_COW (1L << 8) // copy-on-write page (RSW bit, ignored by hardware)
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -0,0 +1,15 @@
+// Kernel statistics reported by the kstat() system call.
+#define KSTAT_EXECFAULT  1  // program pages read in on first touch
+#define KSTAT_TEXTHIT    2  // program pages shared from the text cache
+#define KSTAT_BHIT       3  // buffer cache lookups that found the block
+#define KSTAT_BMISS      4  // buffer cache lookups that did not
+#define KSTAT_BEVICT     5  // cached blocks thrown away to make room
+#define KSTAT_BSIZE      6  // buffers currently in the cache
+#define KSTAT_RAHEAD     7  // blocks read ahead by readi()
+#define KSTAT_DHIT       8  // directory lookups answered by the dcache
+#define KSTAT_DMISS      9  // directory lookups that scanned the directory
+#define KSTAT_IHIT      10  // iget() calls that found the inode in the table
+#define KSTAT_IREAD     11  // inodes ilock() had to read from disk
+#define KSTAT_ISIZE     12  // entries currently in the inode table
+#define KSTAT_BDIRTY    13  // dirty buffers waiting to be written back
+#define KSTAT_BWBACK    14  // dirty blocks written back
@@ -101,6 +101,13 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
+extern uint64 sys_kstat(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_mkhashdir(void);
+extern uint64 sys_sync(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_sched_setaffinity(void);
+extern uint64 sys_sched_getaffinity(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -126,6 +133,13 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_kstat]   sys_kstat,
+[SYS_fsync]   sys_fsync,
+[SYS_mkhashdir] sys_mkhashdir,
+[SYS_sync]    sys_sync,
+[SYS_setpriority] sys_setpriority,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_sched_getaffinity] sys_sched_getaffinity,
 };
 
 void
@@ -20,3 +20,10 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_kstat  22
+#define SYS_fsync  23
+#define SYS_mkhashdir 24
+#define SYS_sync   25
+#define SYS_setpriority 26
+#define SYS_sched_setaffinity 27
+#define SYS_sched_getaffinity 28
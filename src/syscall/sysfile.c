@@ -119,12 +119,37 @@ sys_fstat(void)
   return filestat(f, st);
 }
 
+// Wait until the changes made so far are on the disk.
+// The log commits every file's changes together, so this
+// flushes more than just fd's.
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  log_force();
+  return 0;
+}
+
+// Commit the changes made so far and write every dirty
+// block back to its home location.
+uint64
+sys_sync(void)
+{
+  log_force();
+  bflush(ROOTDEV, 0);
+  return 0;
+}
+
 // Create the path new as a link to the same inode as old.
 uint64
 sys_link(void)
 {
   char name[DIRSIZ], new[MAXPATH], old[MAXPATH];
   struct inode *dp, *ip;
+  int r = -1;
 
   if(argstr(0, old, MAXPATH) < 0 || argstr(1, new, MAXPATH) < 0)
     return -1;
@@ -149,7 +174,7 @@ sys_link(void)
   if((dp = nameiparent(new, name)) == 0)
     goto bad;
   ilock(dp);
-  if(dp->dev != ip->dev || dirlink(dp, name, ip->inum) < 0){
+  if(dp->dev != ip->dev || (r = dirlink(dp, name, ip->inum)) < 0){
     iunlockput(dp);
     goto bad;
   }
@@ -166,7 +191,7 @@ bad:
   iupdate(ip);
   iunlockput(ip);
   end_op();
-  return -1;
+  return r;
 }
 
 // Is the directory dp empty except for "." and ".." ?
@@ -176,6 +201,9 @@ isdirempty(struct inode *dp)
   int off;
   struct dirent de;
 
+  if(dp->flags & DI_HASHDIR)
+    return hdircount(dp) <= 2;  // kept in the directory's first block
+
   for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("isdirempty: readi");
@@ -189,14 +217,15 @@ uint64
 sys_unlink(void)
 {
   struct inode *ip, *dp;
-  struct dirent de;
   char name[DIRSIZ], path[MAXPATH];
   uint off;
+  int res = MAXOPBLOCKS;
 
   if(argstr(0, path, MAXPATH) < 0)
     return -1;
 
-  begin_op();
+again:
+  begin_opn(res);
   if((dp = nameiparent(path, name)) == 0){
     end_op();
     return -1;
@@ -219,9 +248,18 @@ sys_unlink(void)
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  // removing the last link may make iput() truncate the file
+  // in this transaction, after the directory changes; reserve
+  // log space for that too, and start over if this op has less.
+  if(ip->nlink == 1 && MAXOPBLOCKS + itruncblocks(ip) > res){
+    res = MAXOPBLOCKS + itruncblocks(ip);
+    iunlockput(ip);
+    iunlockput(dp);
+    end_op();
+    goto again;
+  }
+
+  dirunlink(dp, name, off);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -242,11 +280,18 @@ bad:
   return -1;
 }
 
+// Create path as a new inode of the given type, or return the
+// existing file for T_FILE.  A new directory gets the DI_* flags
+// in dflags, e.g. DI_HASHDIR.  On failure *err is the value the
+// system call should return.
 static struct inode*
-create(char *path, short type, short major, short minor)
+create(char *path, short type, short major, short minor, int dflags, int *err)
 {
   struct inode *ip, *dp;
   char name[DIRSIZ];
+  int r;
+
+  *err = -1;
 
   if((dp = nameiparent(path, name)) == 0)
     return 0;
@@ -271,6 +316,12 @@ create(char *path, short type, short major, short minor)
   ip->major = major;
   ip->minor = minor;
   ip->nlink = 1;
+  if(type == T_DIR && (dflags & DI_HASHDIR)){
+    // hashed directories are always NDIRHASH blocks long and
+    // may have holes, which extents cannot map.
+    ip->flags = (ip->flags & ~DI_EXTENTS) | DI_HASHDIR;
+    ip->size = NDIRHASH * BSIZE;
+  }
   iupdate(ip);
 
   if(type == T_DIR){  // Create . and .. entries.
@@ -279,8 +330,10 @@ create(char *path, short type, short major, short minor)
       goto fail;
   }
 
-  if(dirlink(dp, name, ip->inum) < 0)
+  if((r = dirlink(dp, name, ip->inum)) < 0){
+    *err = r;
     goto fail;
+  }
 
   if(type == T_DIR){
     // now that success is guaranteed:
@@ -308,7 +361,7 @@ sys_open(void)
   int fd, omode;
   struct file *f;
   struct inode *ip;
-  int n;
+  int n, err;
 
   argint(1, &omode);
   if((n = argstr(0, path, MAXPATH)) < 0)
@@ -317,10 +370,10 @@ sys_open(void)
   begin_op();
 
   if(omode & O_CREATE){
-    ip = create(path, T_FILE, 0, 0);
+    ip = create(path, T_FILE, 0, 0, 0, &err);
     if(ip == 0){
       end_op();
-      return -1;
+      return err;
     }
   } else {
     if((ip = namei(path)) == 0){
@@ -375,11 +428,31 @@ sys_mkdir(void)
 {
   char path[MAXPATH];
   struct inode *ip;
+  int err = -1;
 
   begin_op();
-  if(argstr(0, path, MAXPATH) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
+  if(argstr(0, path, MAXPATH) < 0 || (ip = create(path, T_DIR, 0, 0, 0, &err)) == 0){
     end_op();
-    return -1;
+    return err;
+  }
+  iunlockput(ip);
+  end_op();
+  return 0;
+}
+
+// Make a directory in the hashed format, for directories that
+// will hold many entries.
+uint64
+sys_mkhashdir(void)
+{
+  char path[MAXPATH];
+  struct inode *ip;
+  int err = -1;
+
+  begin_op();
+  if(argstr(0, path, MAXPATH) < 0 || (ip = create(path, T_DIR, 0, 0, DI_HASHDIR, &err)) == 0){
+    end_op();
+    return err;
   }
   iunlockput(ip);
   end_op();
@@ -391,15 +464,15 @@ sys_mknod(void)
 {
   struct inode *ip;
   char path[MAXPATH];
-  int major, minor;
+  int major, minor, err = -1;
 
   begin_op();
   argint(1, &major);
   argint(2, &minor);
   if((argstr(0, path, MAXPATH)) < 0 ||
-     (ip = create(path, T_DEVICE, major, minor)) == 0){
+     (ip = create(path, T_DEVICE, major, minor, 0, &err)) == 0){
     end_op();
-    return -1;
+    return err;
   }
   iunlockput(ip);
   end_op();
@@ -5,6 +5,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "kstat.h"
 
 uint64
 sys_exit(void)
@@ -77,6 +78,47 @@ sys_kill(void)
   return kill(pid);
 }
 
+// set the base scheduling level of process pid, or of the
+// caller if pid is 0; level 0 is the highest.
+uint64
+sys_setpriority(void)
+{
+  int pid, prio;
+
+  argint(0, &pid);
+  argint(1, &prio);
+  if(pid == 0)
+    pid = myproc()->pid;
+  return setpriority(pid, prio);
+}
+
+// restrict process pid, or the caller if pid is 0, to the
+// CPUs in a mask, bit i for CPU i.
+uint64
+sys_sched_setaffinity(void)
+{
+  int pid, mask;
+
+  argint(0, &pid);
+  argint(1, &mask);
+  if(pid == 0)
+    pid = myproc()->pid;
+  return setaffinity(pid, mask);
+}
+
+// return the mask of CPUs process pid, or the caller if pid
+// is 0, may run on.
+uint64
+sys_sched_getaffinity(void)
+{
+  int pid;
+
+  argint(0, &pid);
+  if(pid == 0)
+    pid = myproc()->pid;
+  return getaffinity(pid);
+}
+
 // return how many clock tick interrupts have occurred
 // since start.
 uint64
@@ -89,3 +131,44 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// return the kernel counter selected by the argument,
+// or -1 if there is no such counter.
+uint64
+sys_kstat(void)
+{
+  int which;
+
+  argint(0, &which);
+  switch(which){
+  case KSTAT_EXECFAULT:
+    return execfaults;
+  case KSTAT_TEXTHIT:
+    return texthits;
+  case KSTAT_BHIT:
+    return bcachehits;
+  case KSTAT_BMISS:
+    return bcachemisses;
+  case KSTAT_BEVICT:
+    return bcacheevicts;
+  case KSTAT_BSIZE:
+    return bcachesize();
+  case KSTAT_RAHEAD:
+    return breadaheads;
+  case KSTAT_DHIT:
+    return dcachehits;
+  case KSTAT_DMISS:
+    return dcachemisses;
+  case KSTAT_IHIT:
+    return icachehits;
+  case KSTAT_IREAD:
+    return ireads;
+  case KSTAT_ISIZE:
+    return icachesize();
+  case KSTAT_BDIRTY:
+    return bdirtycount();
+  case KSTAT_BWBACK:
+    return bwritebacks;
+  }
+  return -1;
+}
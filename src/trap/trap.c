@@ -37,6 +37,9 @@ uint ticks;                 // 系统启动以来的时钟滴答数
 // 外部汇编函数声明
 extern char trampoline[], uservec[], userret[];
 
+// start.c 中每个CPU的机器模式定时器数据，见 timerinit()
+extern uint64 timer_scratch[NCPU][7];
+
 // 在 kernelvec.S 中，调用 kerneltrap()。
 // 内核中断向量函数，处理内核态的中断和异常
 void kernelvec();
@@ -69,7 +72,7 @@ trapinithart(void)
 //
 // 陷阱类型包括：
 // 1. 系统调用（ecall 指令）
-// 2. 页错误
+// 2. 页错误（懒分配和写时复制在此处理）
 // 3. 非法指令
 // 4. 设备中断（如定时器、键盘、磁盘等）
 //
@@ -118,6 +121,24 @@ usertrap(void)
 
     // 调用系统调用处理函数
     syscall();
+  } else if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15){
+    // 取指页错误（12）、加载页错误（13）或存储页错误（15）：
+    // vmfault() 为懒分配的堆页面分配清零页面，
+    // 为写时复制页面复制一份可写的私有页面，
+    // 或者从可执行文件中读入尚未加载的程序页面，
+    // 返回后重新执行出错的指令即可
+    uint64 scause = r_scause();
+    uint64 stval = r_stval();
+
+    // 读入程序页面可能需要睡眠等待磁盘，
+    // 已经保存了 scause 和 stval，可以启用中断
+    intr_on();
+
+    if(vmfault(p->pagetable, stval, scause == 15) != 0){
+      printf("usertrap(): unexpected scause %p pid=%d\n", scause, p->pid);
+      printf("            sepc=%p stval=%p\n", p->trapframe->epc, stval);
+      setkilled(p);
+    }
   } else if((which_dev = devintr()) != 0){
     // 设备中断处理
     // devintr() 返回非零值表示这是一个设备中断
@@ -134,11 +155,11 @@ usertrap(void)
     exit(-1);
 
   // 进程调度检查
-  // 如果这是定时器中断，则让出 CPU。
+  // 如果这是定时器中断，时间片用完时让出 CPU。
   // which_dev == 2 表示定时器中断
   // 这是实现抢占式多任务的关键机制
   if(which_dev == 2)
-    yield();  // 让出 CPU，调度其他进程
+    schedtick();  // 必要时让出 CPU，调度其他进程
 
   // 返回用户空间
   usertrapret();
@@ -238,10 +259,10 @@ kerneltrap()
   }
 
   // 内核中的进程调度
-  // 如果这是定时器中断，则让出 CPU。
+  // 如果这是定时器中断，时间片用完时让出 CPU。
   // 允许在内核执行过程中进行进程切换
   if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
-    yield();
+    schedtick();
 
   // 恢复处理器状态
   // yield() 可能导致一些陷阱发生，
@@ -261,6 +282,31 @@ clockintr()
   release(&tickslock);  // 释放锁
 }
 
+// 停止本CPU的定时器，空闲的CPU在 wfi 之前调用。
+// CPU 0 负责 ticks，不能停。调用者已关中断。
+void
+timerstop(void)
+{
+  *(volatile uint64*)CLINT_MTIMECMP(cpuid()) = -1;
+}
+
+// 空闲的CPU醒来后重新开始定时器中断
+void
+timerstart(void)
+{
+  int id = cpuid();
+
+  *(volatile uint64*)CLINT_MTIMECMP(id) =
+    *(volatile uint64*)CLINT_MTIME + timer_scratch[id][4];
+}
+
+// 向CPU id 发送核间中断，把它从 wfi 中唤醒
+void
+ipi(int id)
+{
+  *(volatile uint32*)CLINT_MSIP(id) = 1;
+}
+
 // 设备中断处理函数
 // 检查是否是外部中断或软件中断，
 // 并处理它。
@@ -307,17 +353,22 @@ devintr()
     return 1;
   } else if(scause == 0x8000000000000001L){
     // 软件中断处理
-    // 来自机器模式定时器中断的软件中断，
+    // 来自机器模式定时器中断或核间中断的软件中断，
     // 由 kernelvec.S 中的 timervec 转发。
 
+    // 清除软件中断标志
+    // 通过清除 sip 中的 SSIP 位来确认软件中断。
+    // 先清 SSIP 再取时钟标志，之后到来的时钟中断会再触发一次
+    w_sip(r_sip() & ~2);
+
+    // 核间中断只是把CPU从 wfi 中唤醒，没有别的事要做
+    if(__sync_lock_test_and_set(&timer_scratch[cpuid()][6], 0) == 0)
+      return 1;
+
     // 只有 CPU 0 负责更新全局时钟
     if(cpuid() == 0){
       clockintr();
     }
-    
-    // 清除软件中断标志
-    // 通过清除 sip 中的 SSIP 位来确认软件中断。
-    w_sip(r_sip() & ~2);
 
     return 2;  // 表示定时器中断
   } else {
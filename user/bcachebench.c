@@ -0,0 +1,110 @@
+// Read cached file blocks from several processes at once and
+// report how many block reads per second the kernel sustains
+// as the number of concurrently running workers grows.
+//
+// Each worker rereads its own small file, whose blocks stay in
+// the buffer cache, so the run measures bread()/brelse() and
+// their locking rather than the disk.  Run it with different
+// CPUS= settings to see how the buffer cache scales.  At the
+// end it prints the cache's size and hit/miss/eviction counts
+// as reported by kstat().
+
+#include "types.h"
+#include "src/param.h"
+#include "src/fs/stat.h"
+#include "src/fs/fcntl.h"
+#include "src/syscall/kstat.h"
+#include "user/user.h"
+#include "user/bench.h"
+
+#define NBLOCKS  3    // blocks in each worker's file
+#define BLKSZ    1024
+
+char buf[BLKSZ];
+
+void
+fname(char *name, int i)
+{
+  name[0] = 'b';
+  name[1] = 'c';
+  name[2] = '0' + i;
+  name[3] = 0;
+}
+
+// Create the file for worker i.
+void
+mkfile(int i)
+{
+  char name[4];
+  int fd;
+
+  fname(name, i);
+  if((fd = open(name, O_CREATE | O_WRONLY)) < 0){
+    printf("bcachebench: cannot create %s\n", name);
+    exit(1);
+  }
+  memset(buf, 'a' + i, sizeof(buf));
+  for(int b = 0; b < NBLOCKS; b++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("bcachebench: write %s failed\n", name);
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+// Read worker i's file from start to end.  Returns the number
+// of blocks read.
+uint64
+step(int i)
+{
+  char name[4];
+  uint64 n = 0;
+  int f, cc;
+
+  fname(name, i);
+  if((f = open(name, O_RDONLY)) < 0){
+    printf("bcachebench: cannot open %s\n", name);
+    exit(1);
+  }
+  while((cc = read(f, buf, sizeof(buf))) == sizeof(buf))
+    n++;
+  close(f);
+  if(cc != 0){
+    printf("bcachebench: read %s failed\n", name);
+    exit(1);
+  }
+  return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxproc = 4;
+  char name[4];
+
+  if(argc > 1)
+    maxproc = atoi(argv[1]);
+  if(maxproc > 8)
+    maxproc = 8;  // keep the files within the buffer cache
+
+  for(int i = 0; i < maxproc; i++)
+    mkfile(i);
+
+  printf("bcachebench: %d blocks per file, %d ticks per run\n", NBLOCKS, RUNTICKS);
+  for(int nproc = 1; nproc <= maxproc; nproc *= 2){
+    uint64 total = benchrun("bcachebench", nproc, step);
+    printf("bcachebench: %d workers: %l reads/sec\n",
+           nproc, persec(total, RUNTICKS));
+  }
+
+  for(int i = 0; i < maxproc; i++){
+    fname(name, i);
+    unlink(name);
+  }
+  printf("bcachebench: cache has %l buffers; %l hits, %l misses, %l evictions\n",
+         kstat(KSTAT_BSIZE), kstat(KSTAT_BHIT), kstat(KSTAT_BMISS),
+         kstat(KSTAT_BEVICT));
+  printf("bcachebench: OK\n");
+  exit(0);
+}
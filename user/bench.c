@@ -0,0 +1,71 @@
+// Timing harness shared by the benchmarks.
+
+#include "types.h"
+#include "src/fs/stat.h"
+#include "user/user.h"
+#include "user/bench.h"
+
+// Call step(i) over and over for RUNTICKS ticks, adding up what
+// it returns, and write the sum to fd.
+static void
+worker(int i, uint64 (*step)(int), int fd)
+{
+  uint64 n = 0;
+  int start;
+
+  start = uptime();
+  while(uptime() - start < RUNTICKS)
+    n += step(i);
+  if(write(fd, &n, sizeof(n)) != sizeof(n))
+    exit(1);
+  exit(0);
+}
+
+// Run nproc workers in parallel, worker i calling step(i), and
+// return the sum of what all the calls to step() returned.
+// prog names the benchmark in error messages.
+uint64
+benchrun(char *prog, int nproc, uint64 (*step)(int))
+{
+  int fds[2];
+  uint64 n, total = 0;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", prog);
+    exit(1);
+  }
+  for(int i = 0; i < nproc; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", prog);
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      worker(i, step, fds[1]);
+    }
+  }
+  close(fds[1]);
+  for(int i = 0; i < nproc; i++){
+    int xstatus;
+    if(read(fds[0], &n, sizeof(n)) != sizeof(n)){
+      printf("%s: worker died\n", prog);
+      exit(1);
+    }
+    total += n;
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+  close(fds[0]);
+  return total;
+}
+
+// Rate per second of n events that took the given number of ticks.
+uint64
+persec(uint64 n, int ticks)
+{
+  if(ticks <= 0)
+    ticks = 1;  // faster than the clock can tell
+  return n * TICKHZ / ticks;
+}
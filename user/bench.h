@@ -0,0 +1,7 @@
+// Timing harness shared by the benchmarks in user/; see bench.c.
+
+#define TICKHZ   10   // timer interrupts per second under qemu (see start.c)
+#define RUNTICKS 20   // how long each benchrun() worker runs
+
+uint64 benchrun(char*, int, uint64 (*)(int));
+uint64 persec(uint64, int);
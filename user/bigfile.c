@@ -0,0 +1,72 @@
+// Write a file that needs doubly indirect blocks, read it back,
+// and check every block, reporting the time each pass took.
+//
+// bigfile [nblocks]; the default of 32768 blocks (32 MB) goes
+// well past the singly indirect range.  Blocks beyond
+// NDIRECT + NINDIRECT + NDINDIRECT use the triply indirect
+// block, which needs a file system larger than the default.
+
+#include "types.h"
+#include "src/fs/stat.h"
+#include "src/fs/fs.h"
+#include "src/fs/fcntl.h"
+#include "user/user.h"
+#include "user/bench.h"
+
+char buf[BSIZE];
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, n, t;
+
+  n = 32768;
+  if(argc > 1)
+    n = atoi(argv[1]);
+
+  unlink("bigfile.dat");
+  fd = open("bigfile.dat", O_CREATE | O_WRONLY);
+  if(fd < 0){
+    printf("bigfile: cannot create bigfile.dat\n");
+    exit(1);
+  }
+  t = uptime();
+  for(i = 0; i < n; i++){
+    ((int*)buf)[0] = i;
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("bigfile: write of block %d failed\n", i);
+      exit(1);
+    }
+  }
+  close(fd);
+  t = uptime() - t;
+  printf("bigfile: wrote %d blocks in %d ticks\n", n, t);
+
+  fd = open("bigfile.dat", O_RDONLY);
+  if(fd < 0){
+    printf("bigfile: cannot open bigfile.dat\n");
+    exit(1);
+  }
+  t = uptime();
+  for(i = 0; i < n; i++){
+    if(read(fd, buf, BSIZE) != BSIZE){
+      printf("bigfile: read of block %d failed\n", i);
+      exit(1);
+    }
+    if(((int*)buf)[0] != i){
+      printf("bigfile: block %d holds %d\n", i, ((int*)buf)[0]);
+      exit(1);
+    }
+  }
+  close(fd);
+  t = uptime() - t;
+  printf("bigfile: read %d blocks in %d ticks, %l KB/sec\n",
+         n, t, persec((uint64)n * BSIZE / 1024, t));
+
+  if(unlink("bigfile.dat") < 0){
+    printf("bigfile: unlink failed\n");
+    exit(1);
+  }
+  printf("bigfile: ok\n");
+  exit(0);
+}
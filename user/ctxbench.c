@@ -0,0 +1,76 @@
+// Measure context switch cost.
+//
+// A parent and a child pass one byte back and forth over a pair
+// of pipes NROUND times.  Every round trip puts each process to
+// sleep in read() and wakes the other, so the time per round
+// trip is about two context switches plus two pipe transfers.
+//
+// "ctxbench a b" pins the parent to CPU a and the child to CPU
+// b, so that with a != b every wakeup must rouse a CPU idling
+// in wfi; the rate then measures wakeup latency across CPUs.
+
+#include "types.h"
+#include "src/fs/stat.h"
+#include "user/user.h"
+#include "user/bench.h"
+
+#define NROUND 10000
+
+int
+main(int argc, char *argv[])
+{
+  int ping[2], pong[2];
+  int i, pid, t;
+  int pcpu = -1, ccpu = -1;
+  char c = 'x';
+
+  if(argc == 3){
+    pcpu = atoi(argv[1]);
+    ccpu = atoi(argv[2]);
+  }
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf("ctxbench: pipe failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("ctxbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    if(ccpu >= 0 && sched_setaffinity(0, 1 << ccpu) < 0){
+      printf("ctxbench: no cpu %d\n", ccpu);
+      exit(1);
+    }
+    close(ping[1]);
+    close(pong[0]);
+    for(i = 0; i < NROUND; i++){
+      if(read(ping[0], &c, 1) != 1 || write(pong[1], &c, 1) != 1){
+        printf("ctxbench: child i/o failed\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+
+  if(pcpu >= 0 && sched_setaffinity(0, 1 << pcpu) < 0){
+    printf("ctxbench: no cpu %d\n", pcpu);
+    kill(pid);
+    exit(1);
+  }
+  close(ping[0]);
+  close(pong[1]);
+  t = uptime();
+  for(i = 0; i < NROUND; i++){
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      printf("ctxbench: parent i/o failed\n");
+      exit(1);
+    }
+  }
+  t = uptime() - t;
+  wait(0);
+  printf("ctxbench: %d round trips in %d ticks, %l/sec\n",
+         NROUND, t, persec(NROUND, t));
+  exit(0);
+}
@@ -0,0 +1,62 @@
+// Report how many program pages exec() actually reads.
+//
+// Runs each named program (default: echo) NEXEC times and
+// compares the pages read in on first touch, as counted by
+// kstat(KSTAT_EXECFAULT), with the size of the executable.
+// With demand-paged exec a small run of a large program
+// should read only a fraction of its pages, and once the text
+// pages are in the shared text cache (KSTAT_TEXTHIT) later
+// runs should read little more than their data pages.
+
+#include "types.h"
+#include "src/fs/stat.h"
+#include "src/syscall/kstat.h"
+#include "user/user.h"
+
+#define NEXEC 10
+
+void
+run(char *prog)
+{
+  struct stat st;
+  char *argv[] = { prog, 0 };
+
+  if(stat(prog, &st) < 0){
+    printf("execpages: cannot stat %s\n", prog);
+    exit(1);
+  }
+
+  uint64 before = kstat(KSTAT_EXECFAULT);
+  uint64 hits = kstat(KSTAT_TEXTHIT);
+  for(int n = 0; n < NEXEC; n++){
+    int pid = fork();
+    if(pid < 0){
+      printf("execpages: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(prog, argv);
+      printf("execpages: exec %s failed\n", prog);
+      exit(1);
+    }
+    wait(0);
+  }
+  uint64 faults = kstat(KSTAT_EXECFAULT) - before;
+  hits = kstat(KSTAT_TEXTHIT) - hits;
+
+  printf("%s: %d pages in file, %d pages read and %d shared per exec\n",
+         prog, (int)((st.size + 4095) / 4096), (int)(faults / NEXEC),
+         (int)(hits / NEXEC));
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc < 2){
+    run("echo");
+  } else {
+    for(int i = 1; i < argc; i++)
+      run(argv[i]);
+  }
+  exit(0);
+}
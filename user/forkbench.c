@@ -0,0 +1,47 @@
+// Measure fork() latency for parents of different sizes.
+//
+// For each size the parent grows its heap, touches every page
+// so that it is really resident, and then times NFORK
+// fork()+exit()+wait() round trips.  With copy-on-write fork the
+// cost should stay nearly flat as the parent grows, since only
+// page tables are copied.
+
+#include "types.h"
+#include "src/fs/stat.h"
+#include "user/user.h"
+
+#define NFORK 50
+
+int sizes[] = { 1, 32 };  // parent heap sizes, in MB
+
+int
+main(int argc, char *argv[])
+{
+  for(int i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++){
+    int sz = sizes[i] * 1024 * 1024;
+    char *a = sbrk(sz);
+    if(a == (char*)-1){
+      printf("forkbench: sbrk(%d) failed\n", sz);
+      exit(1);
+    }
+    for(int off = 0; off < sz; off += 4096)
+      a[off] = 1;
+
+    int start = uptime();
+    for(int n = 0; n < NFORK; n++){
+      int pid = fork();
+      if(pid < 0){
+        printf("forkbench: fork failed\n");
+        exit(1);
+      }
+      if(pid == 0)
+        exit(0);
+      wait(0);
+    }
+    int t = uptime() - start;
+    printf("forkbench: %d MB parent: %d forks in %d ticks\n", sizes[i], NFORK, t);
+
+    sbrk(-sz);
+  }
+  exit(0);
+}
@@ -0,0 +1,51 @@
+// Stress the physical page allocator from several processes at
+// once and report how many page allocations per second the kernel
+// sustains as the number of concurrently running workers grows.
+//
+// Run it with different CPUS= settings to see how kalloc()/kfree()
+// scale with the number of harts.
+
+#include "types.h"
+#include "src/param.h"
+#include "src/fs/stat.h"
+#include "user/user.h"
+#include "user/bench.h"
+
+#define NPAGES   64   // pages each worker grows and shrinks by
+
+// Grow the heap by NPAGES pages, touch every page so that it is
+// really backed by physical memory, and give it back.  Returns
+// the number of pages allocated.
+uint64
+step(int i)
+{
+  char *a;
+
+  a = sbrk(NPAGES * 4096);
+  if(a == (char*)-1){
+    printf("kalloctest: sbrk failed\n");
+    exit(1);
+  }
+  for(int p = 0; p < NPAGES; p++)
+    a[p * 4096] = 1;
+  sbrk(-NPAGES * 4096);
+  return NPAGES;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxproc = NCPU;
+
+  if(argc > 1)
+    maxproc = atoi(argv[1]);
+
+  printf("kalloctest: %d pages per round, %d ticks per run\n", NPAGES, RUNTICKS);
+  for(int nproc = 1; nproc <= maxproc; nproc *= 2){
+    uint64 total = benchrun("kalloctest", nproc, step);
+    printf("kalloctest: %d workers: %l allocs/sec\n",
+           nproc, persec(total, RUNTICKS));
+  }
+  printf("kalloctest: OK\n");
+  exit(0);
+}
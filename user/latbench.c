@@ -0,0 +1,86 @@
+// Measure interactive response time while CPU hogs run.
+//
+// Starts NHOG processes that only compute (or as many as the
+// first argument says), then NROUND times sleeps for one tick,
+// as an interactive program waiting for input would, and passes
+// a byte to a helper process and back over pipes.  It reports
+// how many ticks beyond the one it slept each round took, on
+// average and at worst.  A scheduler that favors processes
+// waking from sleep keeps this near zero however many hogs run.
+
+#include "types.h"
+#include "src/fs/stat.h"
+#include "user/user.h"
+
+#define NHOG   6
+#define NROUND 50
+
+int
+main(int argc, char *argv[])
+{
+  int nhog = NHOG, pids[16];
+  int ping[2], pong[2];
+  int i, t, lat, total = 0, worst = 0;
+  char c = 'x';
+
+  if(argc > 1)
+    nhog = atoi(argv[1]);
+  if(nhog < 0 || nhog > 16){
+    printf("latbench: at most 16 hogs\n");
+    exit(1);
+  }
+  for(i = 0; i < nhog; i++){
+    if((pids[i] = fork()) < 0){
+      printf("latbench: fork failed\n");
+      exit(1);
+    }
+    if(pids[i] == 0){
+      for(volatile uint n = 0; ; n++)
+        ;
+    }
+  }
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf("latbench: pipe failed\n");
+    exit(1);
+  }
+  if((t = fork()) < 0){
+    printf("latbench: fork failed\n");
+    exit(1);
+  }
+  if(t == 0){
+    // helper: echo bytes back until the pipe closes.
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1)
+      write(pong[1], &c, 1);
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  for(i = 0; i < NROUND; i++){
+    t = uptime();
+    sleep(1);
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      printf("latbench: pipe i/o failed\n");
+      exit(1);
+    }
+    lat = uptime() - t - 1;
+    if(lat < 0)
+      lat = 0;
+    total += lat;
+    if(lat > worst)
+      worst = lat;
+  }
+  close(ping[1]);
+  wait(0);
+
+  for(i = 0; i < nhog; i++){
+    kill(pids[i]);
+    wait(0);
+  }
+  printf("latbench: %d hogs: %d rounds, %d extra ticks in all, worst %d\n",
+         nhog, NROUND, total, worst);
+  exit(0);
+}
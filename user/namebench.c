@@ -0,0 +1,100 @@
+// Measure path name lookup on deep paths.
+//
+// Makes a directory tree DEPTH levels deep with a file at the
+// bottom, then opens and stats the file, and stats a missing
+// name next to it, N times each, reporting the time taken and
+// how many directory lookups the dcache answered, from kstat().
+
+#include "types.h"
+#include "src/fs/stat.h"
+#include "src/fs/fcntl.h"
+#include "src/syscall/kstat.h"
+#include "user/user.h"
+#include "user/bench.h"
+
+#define DEPTH  8
+#define N      2000
+
+char path[128];
+char missing[128];
+
+void
+report(char *what, int t, uint64 hit, uint64 miss)
+{
+  printf("namebench: %d %s in %d ticks, %l/sec, %l dcache hits, %l misses\n",
+         N, what, t, persec(N, t), kstat(KSTAT_DHIT) - hit,
+         kstat(KSTAT_DMISS) - miss);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct stat st;
+  int i, fd, t, len;
+  uint64 hit, miss;
+
+  // /nb/d1/d2/.../file
+  strcpy(path, "/nb");
+  mkdir(path);
+  for(i = 1; i < DEPTH; i++){
+    len = strlen(path);
+    path[len] = '/';
+    path[len+1] = 'd';
+    path[len+2] = '0' + i;
+    path[len+3] = 0;
+    mkdir(path);
+  }
+  strcpy(missing, path);
+  strcpy(missing + strlen(missing), "/nofile");
+  strcpy(path + strlen(path), "/file");
+  if((fd = open(path, O_CREATE | O_RDWR)) < 0){
+    printf("namebench: cannot create %s\n", path);
+    exit(1);
+  }
+  close(fd);
+
+  hit = kstat(KSTAT_DHIT);
+  miss = kstat(KSTAT_DMISS);
+  t = uptime();
+  for(i = 0; i < N; i++){
+    if((fd = open(path, O_RDONLY)) < 0){
+      printf("namebench: open %s failed\n", path);
+      exit(1);
+    }
+    close(fd);
+  }
+  report("opens", uptime() - t, hit, miss);
+
+  hit = kstat(KSTAT_DHIT);
+  miss = kstat(KSTAT_DMISS);
+  t = uptime();
+  for(i = 0; i < N; i++){
+    if(stat(path, &st) < 0){
+      printf("namebench: stat %s failed\n", path);
+      exit(1);
+    }
+  }
+  report("stats", uptime() - t, hit, miss);
+
+  hit = kstat(KSTAT_DHIT);
+  miss = kstat(KSTAT_DMISS);
+  t = uptime();
+  for(i = 0; i < N; i++){
+    if(stat(missing, &st) == 0){
+      printf("namebench: %s exists\n", missing);
+      exit(1);
+    }
+  }
+  report("failed stats", uptime() - t, hit, miss);
+
+  // clean up, deepest first.
+  unlink(path);
+  for(i = 0; i < DEPTH; i++){
+    len = strlen(path);
+    while(path[len] != '/')
+      len--;
+    path[len] = 0;
+    unlink(path);
+  }
+  exit(0);
+}
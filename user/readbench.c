@@ -0,0 +1,62 @@
+// Measure sequential read throughput of large files.
+//
+// Times wc on each named file (default: usertests) and reports
+// KB/sec, together with how many blocks readi() read ahead and
+// how many buffer cache misses there were, from kstat().
+// Blocks that are already in the buffer cache are not read
+// from the disk again, so the first run after boot is the one
+// that shows the effect of read-ahead.
+
+#include "types.h"
+#include "src/fs/stat.h"
+#include "src/syscall/kstat.h"
+#include "user/user.h"
+#include "user/bench.h"
+
+void
+run(char *file)
+{
+  struct stat st;
+  char *argv[] = { "wc", file, 0 };
+  int start, t, xstatus;
+
+  if(stat(file, &st) < 0){
+    printf("readbench: cannot stat %s\n", file);
+    exit(1);
+  }
+
+  uint64 ra = kstat(KSTAT_RAHEAD);
+  uint64 miss = kstat(KSTAT_BMISS);
+  start = uptime();
+  int pid = fork();
+  if(pid < 0){
+    printf("readbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec("wc", argv);
+    printf("readbench: exec wc failed\n");
+    exit(1);
+  }
+  wait(&xstatus);
+  t = uptime() - start;
+  if(xstatus != 0)
+    exit(1);
+  ra = kstat(KSTAT_RAHEAD) - ra;
+  miss = kstat(KSTAT_BMISS) - miss;
+
+  printf("readbench: %s: %d KB in %d ticks, %l KB/sec, %l blocks read ahead, %l misses\n",
+         file, (int)(st.size / 1024), t, persec(st.size / 1024, t), ra, miss);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc < 2){
+    run("usertests");
+  } else {
+    for(int i = 1; i < argc; i++)
+      run(argv[i]);
+  }
+  exit(0);
+}
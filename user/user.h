@@ -22,6 +22,13 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+uint64 kstat(int);
+int fsync(int);
+int mkhashdir(const char*);
+int sync(void);
+int setpriority(int, int);
+int sched_setaffinity(int, int);
+int sched_getaffinity(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
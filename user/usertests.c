@@ -5,6 +5,7 @@
 #include "fs/fs.h"
 #include "fs/fcntl.h"
 #include "syscall/syscall.h"
+#include "syscall/kstat.h"
 #include "mm/memlayout.h"
 #include "riscv.h"
 
@@ -575,10 +576,12 @@ writetest(char *s)
   }
 }
 
+// write a file that reaches into the doubly indirect blocks.
 void
 writebig(char *s)
 {
   int i, fd, n;
+  int nblocks = NDIRECT + NINDIRECT + 2*NINDIRECT;
 
   fd = open("big", O_CREATE|O_RDWR);
   if(fd < 0){
@@ -586,7 +589,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < nblocks; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed\n", s, i);
@@ -606,7 +609,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != nblocks){
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
       }
@@ -785,6 +788,64 @@ pipe1(char *s)
   }
 }
 
+// several writers and readers on one pipe: wakeups go to one
+// process at a time, which must pass them on, or some of the
+// others would sleep for ever.
+void
+pipemulti(char *s)
+{
+  enum { NW = 4, NR = 4, SZ = 3000, CHUNK = 100 };
+  int fds[2], i, n, pid, xstatus, total;
+  char b[CHUNK];
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NW + NR; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork() failed\n", s);
+      exit(1);
+    }
+    if(pid == 0 && i < NW){
+      close(fds[0]);
+      memset(b, 'a' + i, sizeof(b));
+      for(n = 0; n < SZ; n += CHUNK){
+        if(write(fds[1], b, CHUNK) != CHUNK){
+          printf("%s: write failed\n", s);
+          exit(-1);
+        }
+      }
+      exit(0);
+    }
+    if(pid == 0){
+      // a reader's exit status is the number of bytes it read.
+      close(fds[1]);
+      total = 0;
+      while((n = read(fds[0], b, sizeof(b))) > 0)
+        total += n;
+      exit(total);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  total = 0;
+  for(i = 0; i < NW + NR; i++){
+    wait(&xstatus);
+    if(xstatus < 0){
+      printf("%s: child failed\n", s);
+      exit(1);
+    }
+    total += xstatus;
+  }
+  if(total != NW * SZ){
+    printf("%s: read %d bytes, expected %d\n", s, total, NW * SZ);
+    exit(1);
+  }
+}
+
 
 // test if child is killed (status = -1)
 void
@@ -2571,6 +2632,652 @@ badarg(char *s)
   exit(0);
 }
 
+// parent and child of a copy-on-write fork must each see only
+// their own writes, including writes the kernel makes on their
+// behalf with copyout().
+void
+cowfork(char *s)
+{
+  enum { N = 16 };
+  int fds[2], xstatus;
+  char *a = sbrk(N*4096);
+
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < N; i++)
+    a[i*4096] = 'p';
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+
+  int pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(int i = 0; i < N; i++){
+      if(a[i*4096] != 'p'){
+        printf("%s: child sees wrong data\n", s);
+        exit(1);
+      }
+      // leave the last page shared.
+      if(i < N-1)
+        a[i*4096] = 'c';
+    }
+    // copyout() into a page that is still shared.
+    if(read(fds[0], a + (N-1)*4096, 1) != 1 || a[(N-1)*4096] != 'x'){
+      printf("%s: read into shared page failed\n", s);
+      exit(1);
+    }
+    exit(0);
+  }
+
+  if(write(fds[1], "x", 1) != 1){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  for(int i = 0; i < N; i++){
+    if(a[i*4096] != 'p'){
+      printf("%s: parent sees child's write\n", s);
+      exit(1);
+    }
+  }
+  if(a[(N-1)*4096] == 'x'){
+    printf("%s: parent sees child's read()\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// sbrk() only reserves address space; pages are allocated on
+// first touch, either by the program or by the kernel's copyin()
+// and copyout().  a reservation far larger than physical memory
+// must therefore succeed as long as little of it is used.
+void
+lazysbrk(char *s)
+{
+  enum { BIG=1024*1024*1024 };
+  char *a, *top;
+  int fd;
+
+  a = sbrk(BIG);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk(%d) failed\n", s, BIG);
+    exit(1);
+  }
+  top = sbrk(0);
+  a[0] = 1;
+  top[-1] = 2;
+  if(a[0] != 1 || top[-1] != 2 || a[BIG/2] != 0){
+    printf("%s: lazily allocated memory has wrong contents\n", s);
+    exit(1);
+  }
+
+  // kernel writes into, and reads from, pages that were never touched.
+  fd = open("README", O_RDONLY);
+  if(fd < 0 || read(fd, a + BIG/4, 10) != 10){
+    printf("%s: read into untouched page failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("lazysbrk", O_CREATE|O_WRONLY);
+  if(fd < 0 || write(fd, a + 3*(BIG/4), 10) != 10){
+    printf("%s: write from untouched page failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("lazysbrk");
+
+  if(sbrk(-BIG) == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk(-%d) failed\n", s, BIG);
+    exit(1);
+  }
+}
+
+// writes return before the log commits them; fsync() waits
+// for the commit.  the data must read back the same either way.
+void
+fsynctest(char *s)
+{
+  char buf[64];
+  int fd, i;
+
+  fd = open("fsyncf", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create fsyncf failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 20; i++){
+    memset(buf, 'a' + i, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write fsyncf failed\n", s);
+      exit(1);
+    }
+    if(i % 5 == 0 && fsync(fd) != 0){
+      printf("%s: fsync failed\n", s);
+      exit(1);
+    }
+  }
+  if(fsync(fd) != 0){
+    printf("%s: fsync failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(fsync(fd) != -1){
+    printf("%s: fsync of closed fd succeeded\n", s);
+    exit(1);
+  }
+
+  fd = open("fsyncf", O_RDONLY);
+  for(i = 0; i < 20; i++){
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf) || buf[0] != 'a' + i ||
+       buf[sizeof(buf)-1] != 'a' + i){
+      printf("%s: fsyncf has wrong contents\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("fsyncf");
+}
+
+// a hashed directory holds many names, and unlink refuses to
+// remove it until only "." and ".." are left.
+void
+hashdir(char *s)
+{
+  enum { N = 1000 };
+  int i, fd;
+  char name[16];
+
+  unlink("hd/f");
+  unlink("hd");
+  if(mkhashdir("hd") < 0){
+    printf("%s: mkhashdir failed\n", s);
+    exit(1);
+  }
+  fd = open("hd/f", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create hd/f failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  strcpy(name, "hd/x000");
+  for(i = 0; i < N; i++){
+    name[4] = '0' + i / 100;
+    name[5] = '0' + (i / 10) % 10;
+    name[6] = '0' + i % 10;
+    if(link("hd/f", name) != 0){
+      printf("%s: link(hd/f, %s) failed\n", s, name);
+      exit(1);
+    }
+  }
+  if(unlink("hd") == 0){
+    printf("%s: unlinked non-empty hashed directory\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    name[4] = '0' + i / 100;
+    name[5] = '0' + (i / 10) % 10;
+    name[6] = '0' + i % 10;
+    if((fd = open(name, O_RDONLY)) < 0){
+      printf("%s: open %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+    if(unlink(name) != 0){
+      printf("%s: unlink %s failed\n", s, name);
+      exit(1);
+    }
+    if(open(name, O_RDONLY) >= 0){
+      printf("%s: %s still there after unlink\n", s, name);
+      exit(1);
+    }
+  }
+  if(unlink("hd/f") != 0 || unlink("hd") != 0){
+    printf("%s: cannot remove hd\n", s);
+    exit(1);
+  }
+}
+
+// names that all hash to one block of a hashed directory fill it
+// and its probe blocks, after which link() and open(O_CREATE)
+// return EDIRFULL rather than a generic failure.
+void
+hashdirfull(char *s)
+{
+  enum { HOME = 5 };
+  int i, n, fd;
+  char name[16];
+
+  unlink("hdf/f");
+  unlink("hdf");
+  if(mkhashdir("hdf") < 0 || (fd = open("hdf/f", O_CREATE | O_RDWR)) < 0){
+    printf("%s: cannot make hdf\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  strcpy(name, "hdf/y0000");
+  for(i = 0, n = 0; i < 10000; i++){
+    name[5] = '0' + i / 1000;
+    name[6] = '0' + (i / 100) % 10;
+    name[7] = '0' + (i / 10) % 10;
+    name[8] = '0' + i % 10;
+    if(dirhash(name + 4) % NDIRHASH != HOME)
+      continue;
+    if(n < DIRPROBE * (DPB - 1)){
+      if(link("hdf/f", name) != 0){
+        printf("%s: link(hdf/f, %s) failed\n", s, name);
+        exit(1);
+      }
+      n++;
+    } else {
+      if(link("hdf/f", name) != EDIRFULL){
+        printf("%s: link into full probe blocks did not fail with EDIRFULL\n", s);
+        exit(1);
+      }
+      if(open(name, O_CREATE | O_RDWR) != EDIRFULL){
+        printf("%s: create in full probe blocks did not fail with EDIRFULL\n", s);
+        exit(1);
+      }
+      break;
+    }
+  }
+  if(i == 10000){
+    printf("%s: too few names hash to block %d\n", s, HOME);
+    exit(1);
+  }
+
+  for(i = 0; i < 10000; i++){
+    name[5] = '0' + i / 1000;
+    name[6] = '0' + (i / 100) % 10;
+    name[7] = '0' + (i / 10) % 10;
+    name[8] = '0' + i % 10;
+    if(dirhash(name + 4) % NDIRHASH == HOME)
+      unlink(name);
+  }
+  if(unlink("hdf/f") != 0 || unlink("hdf") != 0){
+    printf("%s: cannot remove hdf\n", s);
+    exit(1);
+  }
+}
+
+// setpriority() accepts levels 0..NPRIO-1 of existing processes,
+// and a process keeps running at the lowest level.  Of two
+// CPU-bound processes sharing one CPU, the one at level 0 gets
+// more of it, since every boost puts it ahead of the other.
+void
+setprio(char *s)
+{
+  enum { RUNTICKS = 4 * BOOSTTICKS };
+  int pid, xstatus, old, end, fds[2][2];
+  uint64 n, count[2];
+
+  if(setpriority(0, -1) != -1 || setpriority(0, NPRIO) != -1){
+    printf("%s: setpriority accepted a bad level\n", s);
+    exit(1);
+  }
+  if(setpriority(NPROC * 1000, 0) != -1){
+    printf("%s: setpriority of a missing process succeeded\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sleep(2);
+    exit(7);
+  }
+  if(setpriority(pid, NPRIO-1) != 0){
+    printf("%s: setpriority of child failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 7){
+    printf("%s: child at lowest level exited with %d\n", s, xstatus);
+    exit(1);
+  }
+  if(setpriority(0, 0) != 0){
+    printf("%s: setpriority of self failed\n", s);
+    exit(1);
+  }
+
+  // a child at level 0 and one at NPRIO-1, both held to CPU 0,
+  // count how often they get around a loop until a common end.
+  // The level NPRIO-1 child is forked first, so any head start
+  // is its.
+  old = sched_getaffinity(0);
+  if(sched_setaffinity(0, 1) != 0){
+    printf("%s: sched_setaffinity failed\n", s);
+    exit(1);
+  }
+  end = uptime() + RUNTICKS;
+  for(int i = 1; i >= 0; i--){
+    if(pipe(fds[i]) < 0){
+      printf("%s: pipe failed\n", s);
+      exit(1);
+    }
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[i][0]);
+      if(setpriority(0, i == 0 ? 0 : NPRIO-1) != 0)
+        exit(1);
+      for(n = 0; uptime() < end; n++)
+        ;
+      if(write(fds[i][1], &n, sizeof(n)) != sizeof(n))
+        exit(1);
+      exit(0);
+    }
+    close(fds[i][1]);
+  }
+  sched_setaffinity(0, old);
+  for(int i = 0; i < 2; i++){
+    if(read(fds[i][0], &count[i], sizeof(count[i])) != sizeof(count[i])){
+      printf("%s: CPU-bound child died\n", s);
+      exit(1);
+    }
+    close(fds[i][0]);
+  }
+  for(int i = 0; i < 2; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: CPU-bound child failed\n", s);
+      exit(1);
+    }
+  }
+  if(count[0] <= count[1]){
+    printf("%s: level 0 ran %l loops, level %d ran %l\n",
+           s, count[0], NPRIO-1, count[1]);
+    exit(1);
+  }
+}
+
+// a process pinned to CPU 0 stays runnable there, and its
+// children inherit the mask.
+void
+affinity(char *s)
+{
+  int old, pid, xstatus;
+
+  old = sched_getaffinity(0);
+  if(old <= 0 || (old & 1) == 0){
+    printf("%s: bad initial affinity %x\n", s, old);
+    exit(1);
+  }
+  if(sched_setaffinity(0, 0) != -1){
+    printf("%s: empty mask accepted\n", s);
+    exit(1);
+  }
+  if(sched_setaffinity(0, 1) != 0 || sched_getaffinity(0) != 1){
+    printf("%s: cannot pin to CPU 0\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(volatile int i = 0; i < 1000000; i++)
+      ;
+    exit(sched_getaffinity(0) == 1 ? 0 : 1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child did not inherit affinity\n", s);
+    exit(1);
+  }
+  if(sched_getaffinity(NPROC * 1000) != -1){
+    printf("%s: affinity of a missing process\n", s);
+    exit(1);
+  }
+  if(sched_setaffinity(0, old) != 0){
+    printf("%s: cannot restore affinity\n", s);
+    exit(1);
+  }
+}
+
+// a freshly exec'd program writes a string literal into a pipe:
+// the page is read from the executable before the pipe is locked.
+void
+execpipe(char *s)
+{
+  int fds[2], pid, n, xstatus;
+  char buf[8];
+  char *args[] = { "echo", "hi", 0 };
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(1);
+    dup(fds[1]);
+    close(fds[0]);
+    close(fds[1]);
+    exec("echo", args);
+    exit(1);
+  }
+  close(fds[1]);
+  n = 0;
+  while(n < sizeof(buf) && read(fds[0], buf + n, 1) == 1)
+    n++;
+  close(fds[0]);
+  wait(&xstatus);
+  if(xstatus != 0 || n != 3 || memcmp(buf, "hi\n", 3) != 0){
+    printf("%s: echo wrote %d bytes, status %d\n", s, n, xstatus);
+    exit(1);
+  }
+}
+
+// processes pinned to different CPUs wake each other through
+// pipes; each wakeup must rouse a CPU sleeping in wfi.
+void
+ipiwake(char *s)
+{
+  enum { N = 200 };
+  int ping[2], pong[2];
+  int i, pid, old, xstatus;
+  char c = 'x';
+
+  old = sched_getaffinity(0);
+  if(sched_setaffinity(0, 2) != 0)
+    return;  // only one CPU
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    for(i = 0; i < N; i++){
+      if(read(ping[0], &c, 1) != 1 || write(pong[1], &c, 1) != 1)
+        exit(1);
+    }
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+  if(sched_setaffinity(0, 1) != 0){
+    printf("%s: cannot pin to CPU 0\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      printf("%s: round trip %d failed\n", s, i);
+      exit(1);
+    }
+  }
+  close(ping[1]);
+  close(pong[0]);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child failed\n", s);
+    exit(1);
+  }
+  sched_setaffinity(0, old);
+}
+
+// committed blocks are written home by the write-back cache;
+// sync() leaves nothing dirty.
+void
+writeback(char *s)
+{
+  enum { N = 16 };
+  char buf[BSIZE];
+  int fd, i;
+
+  fd = open("wbf", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create wbf failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    memset(buf, 'a' + i, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write wbf failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  if(sync() != 0){
+    printf("%s: sync failed\n", s);
+    exit(1);
+  }
+  if(kstat(KSTAT_BDIRTY) != 0){
+    printf("%s: %l dirty blocks after sync\n", s, kstat(KSTAT_BDIRTY));
+    exit(1);
+  }
+
+  fd = open("wbf", O_RDONLY);
+  for(i = 0; i < N; i++){
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf) || buf[0] != 'a' + i ||
+       buf[sizeof(buf)-1] != 'a' + i){
+      printf("%s: wbf has wrong contents\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("wbf");
+}
+
+// an inode whose last reference was dropped stays in the inode
+// table, so opening the file again does not read the inode from
+// disk; and the table grows to hold more than NINODE inodes.
+void
+icache(char *s)
+{
+  enum { N = 100, NCHILD = 5, NF = 12 };
+  int i, j, fd, pid, ready[2], done[2];
+  uint64 reads, hits;
+  char name[8], c;
+
+  fd = open("icf", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create icf failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  reads = kstat(KSTAT_IREAD);
+  hits = kstat(KSTAT_IHIT);
+  for(i = 0; i < N; i++){
+    if((fd = open("icf", O_RDONLY)) < 0){
+      printf("%s: open icf failed\n", s);
+      exit(1);
+    }
+    close(fd);
+  }
+  if(kstat(KSTAT_IREAD) != reads){
+    printf("%s: reopening icf read %l inodes\n", s, kstat(KSTAT_IREAD) - reads);
+    exit(1);
+  }
+  if(kstat(KSTAT_IHIT) - hits < N){
+    printf("%s: only %l inode table hits\n", s, kstat(KSTAT_IHIT) - hits);
+    exit(1);
+  }
+  unlink("icf");
+
+  // children hold NCHILD*NF files open at once.
+  if(pipe(ready) < 0 || pipe(done) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(done[1]);
+      strcpy(name, "ic00");
+      for(j = 0; j < NF; j++){
+        name[2] = 'a' + i;
+        name[3] = 'a' + j;
+        if(open(name, O_CREATE | O_RDWR) < 0){
+          printf("%s: create %s failed\n", s, name);
+          exit(1);
+        }
+      }
+      write(ready[1], "x", 1);
+      read(done[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(done[0]);
+  for(i = 0; i < NCHILD; i++){
+    if(read(ready[0], &c, 1) != 1){
+      printf("%s: child failed\n", s);
+      exit(1);
+    }
+  }
+  if(kstat(KSTAT_ISIZE) < NCHILD * NF){
+    printf("%s: inode table did not grow\n", s);
+    exit(1);
+  }
+  close(done[1]);
+  for(i = 0; i < NCHILD; i++)
+    wait(0);
+  close(ready[0]);
+  close(ready[1]);
+
+  strcpy(name, "ic00");
+  for(i = 0; i < NCHILD; i++){
+    for(j = 0; j < NF; j++){
+      name[2] = 'a' + i;
+      name[3] = 'a' + j;
+      unlink(name);
+    }
+  }
+}
+
 struct test {
   void (*f)(char *);
   char *s;
@@ -2594,6 +3301,7 @@ struct test {
   {dirtest, "dirtest"},
   {exectest, "exectest"},
   {pipe1, "pipe1"},
+  {pipemulti, "pipemulti"},
   {killstatus, "killstatus"},
   {preempt, "preempt"},
   {exitwait, "exitwait"},
@@ -2635,6 +3343,17 @@ struct test {
   {sbrklast, "sbrklast"},
   {sbrk8000, "sbrk8000"},
   {badarg, "badarg" },
+  {cowfork, "cowfork"},
+  {lazysbrk, "lazysbrk"},
+  {fsynctest, "fsynctest"},
+  {hashdir, "hashdir"},
+  {hashdirfull, "hashdirfull"},
+  {icache, "icache"},
+  {writeback, "writeback"},
+  {setprio, "setprio"},
+  {affinity, "affinity"},
+  {ipiwake, "ipiwake"},
+  {execpipe, "execpipe"},
 
   { 0, 0},
 };
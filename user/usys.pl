@@ -36,3 +36,10 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("kstat");
+entry("fsync");
+entry("mkhashdir");
+entry("sync");
+entry("setpriority");
+entry("sched_setaffinity");
+entry("sched_getaffinity");